@@ -0,0 +1,278 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "simulation.hpp"
+#include "pconfig.hpp"
+#include "generator.hpp"
+
+/*
+ * Benchmark of the physics engine.
+ *
+ * Every workload is loaded into a new simulation which then processes
+ * a fixed number of events without any window. A workload is either
+ * one of the configuration files or generators (see Generator::fromSpec)
+ * run in a 600x600 box, like the examples in the README, or a synthetic
+ * system described as synthetic:<particles>:<density>:<polydispersity>:
+ * the particles are put on a lattice in a box sized so that they cover
+ * the given fraction of it, polydispersity is the relative spread of
+ * their radii around mean_radius.
+ *
+ * The results are printed as CSV, one line per workload and
+ * broadphase, so that runs can be compared by a script.
+ */
+
+static const int replay_size = 600;
+
+// mean radius of synthetic particles, it's large enough
+// for the integer radii to have some spread
+static const double mean_radius = 10.0;
+
+static const char *default_workloads[] = {
+    "1000p", "brownian", "billiards",
+    "synthetic:1000:0.1:0", "synthetic:1000:0.4:0.3",
+    "synthetic:10000:0.05:0", "synthetic:10000:0.3:0.5",
+};
+
+struct Workload {
+    std::string name;
+    std::string path; // config file
+    std::string generator; // or generator spec, both empty for synthetic ones
+    long nparticles;
+    double density;
+    double polydispersity;
+};
+
+static void usage(const char *appname)
+{
+    std::cerr << "Usage: " << appname << " [-e <events>] [-b <broadphases>] "
+        "[-j <threads>] [-s <seed>] [-c <configs dir>] [workload...]"
+              << std::endl;
+    std::cerr << "  -e: number of events to process per workload "
+              << "(default 100000)" << std::endl;
+    std::cerr << "  -b: comma separated list of broadphases to run: "
+              << "full, grid, lists, sweep (default full,grid,lists,sweep)"
+              << std::endl;
+    std::cerr << "  -j: number of threads predicting the initial events "
+              << "(all cores by default)" << std::endl;
+    std::cerr << "  -s: seed of synthetic workloads (default 1)" << std::endl;
+    std::cerr << "  -c: directory with the configuration files "
+              << "(default configs)" << std::endl;
+    std::cerr << "  workload: a configuration file name, a generator "
+              << "(see headless) or" << std::endl
+              << "    synthetic:<particles>:<density>:<polydispersity>"
+              << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+static std::vector<std::string> split(const std::string &str, char sep)
+{
+    std::vector<std::string> parts;
+    std::istringstream iss(str);
+    std::string part;
+
+    while (std::getline(iss, part, sep))
+        parts.push_back(part);
+    return parts;
+}
+
+static Workload parse_workload(const std::string &spec,
+                               const std::string &configs)
+{
+    Workload w;
+    std::vector<std::string> parts = split(spec, ':');
+
+    w.name = spec;
+    w.nparticles = 0;
+    w.density = w.polydispersity = 0.0;
+    if (Generator::isSpec(spec)) {
+        w.generator = spec;
+        return w;
+    }
+    if (parts[0] != "synthetic") {
+        w.path = (spec.find('/') == std::string::npos) ?
+            configs + "/" + spec : spec;
+        return w;
+    }
+
+    if (parts.size() != 4)
+        throw std::invalid_argument("Bad synthetic workload " + spec);
+
+    w.nparticles = strtol(parts[1].c_str(), NULL, 10);
+    w.density = strtod(parts[2].c_str(), NULL);
+    w.polydispersity = strtod(parts[3].c_str(), NULL);
+    if (w.nparticles <= 0 || w.density <= 0 || w.density >= 1 ||
+        w.polydispersity < 0 || w.polydispersity >= 1) {
+        throw std::invalid_argument("Bad synthetic workload " + spec);
+    }
+
+    return w;
+}
+
+// Particles of a synthetic workload are put on a jittered lattice.
+static void generate(Simulation &simulation, const Workload &w,
+                     unsigned long seed)
+{
+    Generator generator(simulation.getWidth(), simulation.getHeight(), seed);
+
+    simulation.addParticles(generator.lattice(w.nparticles, mean_radius,
+                                              w.polydispersity,
+                                              2 * mean_radius));
+}
+
+// the size of the box the particles of a synthetic
+// workload cover the requested fraction of
+static int synthetic_size(const Workload &w)
+{
+    double area = Generator::meanArea(mean_radius, w.polydispersity);
+
+    return std::ceil(std::sqrt(w.nparticles * area / w.density));
+}
+
+static void load(Simulation &simulation, const std::string &path)
+{
+    PConfig cfg(path.c_str());
+
+    std::vector<PConfigEntry> entries = cfg.readAll();
+
+    simulation.reserve(entries.size());
+    for (const PConfigEntry &entry : entries) {
+        simulation.addParticle(entry.rx, entry.ry, entry.vx, entry.vy,
+                               entry.radius, entry.mass,
+                               entry.r, entry.g, entry.b);
+    }
+}
+
+static void bench(const Workload &w, const std::string &broadphase,
+                  uint64_t nevents, unsigned nthreads, unsigned long seed)
+{
+    typedef std::chrono::steady_clock clock;
+    bool synthetic = w.path.empty() && w.generator.empty();
+    int size = synthetic ? synthetic_size(w) : replay_size;
+    Simulation simulation(size, size);
+
+    if (broadphase == "grid")
+        simulation.enableGrid();
+    else if (broadphase != "full" && broadphase != "lists" &&
+             broadphase != "sweep")
+        throw std::invalid_argument("Unknown broadphase " + broadphase);
+    if (nthreads > 0)
+        simulation.setThreads(nthreads);
+
+    if (synthetic)
+        generate(simulation, w, seed);
+    else if (!w.generator.empty())
+        simulation.addParticles(Generator(size, size,
+                                          seed).fromSpec(w.generator));
+    else
+        load(simulation, w.path);
+
+    // the skin (and the horizon) is the diameter of the biggest particle;
+    // the expiries count as events, so compare the simulation time covered
+    int diameter = std::max(2 * simulation.getParticles().getMaxRadius(), 1);
+
+    if (broadphase == "lists")
+        simulation.enableNeighborLists(diameter);
+    else if (broadphase == "sweep")
+        simulation.enableSweep(diameter);
+
+    // the first request for the next event sets up the queue
+    auto start = clock::now();
+    simulation.nextEventTime();
+    std::chrono::duration<double> init_time = clock::now() - start;
+
+    start = clock::now();
+    simulation.run(nevents);
+    std::chrono::duration<double> run_time = clock::now() - start;
+
+    uint64_t processed = simulation.getEventCount();
+    uint64_t stale = simulation.getStaleCount();
+
+    std::cout << w.name << "," << broadphase << ","
+              << simulation.getParticles().size() << ","
+              << size << "," << processed << ","
+              << simulation.getTime() << ","
+              << init_time.count() << "," << run_time.count() << ","
+              << processed / run_time.count() << ","
+              << (double)stale / std::max<uint64_t>(processed + stale, 1) << ","
+              << simulation.getPeakQueueSize() << ","
+              << simulation.memoryUsage() << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t nevents = 100000;
+    std::string broadphases = "full,grid,lists,sweep";
+    std::string configs = "configs";
+    unsigned nthreads = 0;
+    unsigned long seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:b:j:s:c:")) != -1) {
+        switch (opt) {
+        case 'e':
+            nevents = strtoull(optarg, NULL, 10);
+            break;
+        case 'b':
+            broadphases = optarg;
+            break;
+        case 'j':
+            nthreads = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            configs = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    std::vector<std::string> specs(argv + optind, argv + argc);
+
+    if (specs.empty()) {
+        specs.assign(std::begin(default_workloads),
+                     std::end(default_workloads));
+    }
+
+    try {
+        std::vector<Workload> workloads;
+
+        for (const std::string &spec : specs)
+            workloads.push_back(parse_workload(spec, configs));
+
+        std::cout << "workload,broadphase,particles,box,events,"
+                  << "simulation_time,init_s,run_s,events_per_s,"
+                  << "stale_ratio,peak_queue,memory_bytes" << std::endl;
+        for (const Workload &w : workloads) {
+            for (const std::string &broadphase : split(broadphases, ','))
+                bench(w, broadphase, nevents, nthreads, seed);
+        }
+    }
+    catch (PConfigError &e) {
+        std::cerr << "Configuration file error: [l: " << e.getLine()
+                  << ", c: " << e.getColumn() << "]: " << e.what() << std::endl;
+        std::cerr << "Format: " << PConfig::formatString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (SimulationError &e) {
+        std::cerr << "Simulation error: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,496 @@
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "checkpoint.hpp"
+
+namespace {
+
+const char magic[8] = {'P', 'A', 'R', 'T', 'C', 'K', 'P', 'T'};
+const uint32_t byte_order = 0x01020304;
+
+enum : uint32_t {
+    HasGrid = 1, // the simulation uses the grid broadphase
+    HasEvents = 2, // pending events (and grid binning) are saved
+    HasLists = 4, // the simulation uses the neighbor lists
+    FlatGrid = 8, // the grid is not allowed to have several levels
+    HasSweep = 16, // the simulation uses the sweep index
+};
+
+struct Header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t flags;
+    int32_t width, height;
+    uint32_t nparticles;
+    double now;
+    uint64_t nevents, nstale;
+    // the grid, if the events are saved
+    double cell_size;
+    uint32_t ncells, nlevels;
+    // number of pending events
+    uint32_t nqueued;
+    // ScalarPolicy<T>::id of the particle arrays
+    uint32_t scalar;
+    // skin of the neighbor lists
+    double skin;
+    // horizon of the sweep index
+    double horizon;
+};
+
+// an event together with the queue slot it sits in;
+// unlike Event it has no uninitialised padding
+struct EventRecord {
+    uint32_t slot;
+    uint8_t type, wtype;
+    uint16_t unused;
+    double time;
+    uint32_t pa, pb, pa_rev, pb_rev;
+};
+
+static_assert(sizeof(Header) % 8 == 0, "header breaks alignment");
+static_assert(sizeof(EventRecord) == 32, "event record is not packed");
+
+size_t padding(size_t bytes)
+{
+    return (8 - bytes % 8) % 8;
+}
+
+// the slot and the particles are in range, the event is of a known type
+// and the simulation has the broadphase it comes from
+bool validRecord(const EventRecord &rec, const Header &header)
+{
+    uint32_t n = header.nparticles;
+
+    if (rec.slot > n || rec.wtype > static_cast<uint8_t>(WallType::Horisontal))
+        return false;
+
+    switch (static_cast<EventType>(rec.type)) {
+    case EventType::Refresh:
+        return true;
+    case EventType::WallCollision:
+        return rec.pa < n;
+    case EventType::ParticleCollision:
+        return rec.pa < n && rec.pb < n;
+    case EventType::CellCrossing:
+        return rec.pa < n && (header.flags & HasGrid) && rec.pb < header.ncells;
+    case EventType::ListExpiry:
+        return rec.pa < n && (header.flags & HasLists);
+    case EventType::IntervalExpiry:
+        return rec.pa < n && (header.flags & HasSweep);
+    }
+
+    return false;
+}
+
+std::string describeError(const std::string &path)
+{
+    return path + ": " + strerror(errno);
+}
+
+class Writer {
+private:
+    std::ofstream file;
+
+public:
+    explicit Writer(const std::string &path)
+        : file(path, std::ios::binary | std::ios::trunc) {}
+
+    bool fail() const {
+        return file.fail();
+    }
+
+    void write(const void *data, size_t bytes) {
+        static const char zeros[8] = {0};
+
+        file.write(static_cast<const char *>(data), bytes);
+        file.write(zeros, padding(bytes));
+    }
+
+    template <typename T>
+    void write(const std::vector<T> &v) {
+        write(v.data(), v.size() * sizeof(T));
+    }
+
+    void close() {
+        file.close();
+    }
+};
+
+// goes through the file mapped to memory
+class Reader {
+private:
+    const char *data;
+    size_t size, offset;
+
+public:
+    Reader(const void *data, size_t size)
+        : data(static_cast<const char *>(data)), size(size), offset(0) {}
+
+    template <typename T>
+    const T *take(size_t n) {
+        size_t bytes = n * sizeof(T);
+        const T *ptr = reinterpret_cast<const T *>(data + offset);
+
+        if (bytes > size - offset)
+            throw CheckpointError("Checkpoint is truncated");
+
+        offset = std::min(offset + bytes + padding(bytes), size);
+        return ptr;
+    }
+
+    template <typename T>
+    void read(std::vector<T> &v, size_t n) {
+        const T *ptr = take<T>(n);
+
+        v.assign(ptr, ptr + n);
+    }
+
+    bool atEnd() const {
+        return offset >= size;
+    }
+};
+
+// the file mapped to memory for the time of reading
+class Mapping {
+public:
+    void *data;
+    size_t size;
+
+    explicit Mapping(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+
+        if (fd < 0)
+            throw CheckpointError(describeError(path));
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            throw CheckpointError(describeError(path));
+        }
+
+        size = st.st_size;
+        if (size < sizeof(Header)) {
+            close(fd);
+            throw CheckpointError(path + " is not a checkpoint");
+        }
+
+        data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED)
+            throw CheckpointError(describeError(path));
+    }
+
+    ~Mapping() {
+        munmap(data, size);
+    }
+};
+
+}
+
+void Checkpoint::save(const Simulation &simulation, const std::string &path,
+                      bool with_events)
+{
+    const ParticleStore &particles = simulation.particles;
+    const Grid *grid = simulation.grid.get();
+    const NeighborLists *lists = simulation.lists.get();
+    const SweepIndex *sweep = simulation.sweep.get();
+    const EventQueue &events = simulation.events;
+    Header header;
+
+    // the grid binning is part of the event state: it's
+    // built from scratch when the events are predicted again
+    with_events = with_events && simulation.initialized;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.byte_order = byte_order;
+    header.version = version;
+    if (simulation.use_grid)
+        header.flags |= HasGrid;
+    if (simulation.skin > 0)
+        header.flags |= HasLists;
+    if (simulation.horizon > 0)
+        header.flags |= HasSweep;
+    if (!simulation.hierarchical)
+        header.flags |= FlatGrid;
+    if (with_events)
+        header.flags |= HasEvents;
+    header.width = simulation.width;
+    header.height = simulation.height;
+    header.scalar = ScalarPolicy<Scalar>::id;
+    header.nparticles = particles.size();
+    header.now = simulation.now;
+    header.nevents = simulation.nevents;
+    header.nstale = simulation.nstale;
+    if (with_events && grid) {
+        header.cell_size = grid->getCellSize();
+        header.ncells = grid->cells.size();
+        header.nlevels = grid->getLevels();
+    }
+    if (with_events)
+        header.nqueued = events.size();
+    header.skin = simulation.skin;
+    header.horizon = simulation.horizon;
+
+    std::string tmp_path = path + ".tmp";
+    Writer out(tmp_path);
+
+    if (out.fail())
+        throw CheckpointError(describeError(tmp_path));
+
+    out.write(&header, sizeof(header));
+    out.write(particles.x);
+    out.write(particles.y);
+    out.write(particles.t);
+    out.write(particles.vx);
+    out.write(particles.vy);
+    out.write(particles.radius);
+    out.write(particles.mass);
+    out.write(particles.rev);
+    out.write(particles.color);
+
+    if (with_events && grid) {
+        // cells are written one after another with their starting
+        // offsets, keeping the order of particles within each cell
+        std::vector<uint32_t> start, members;
+
+        for (const std::vector<uint32_t> &cell : grid->cells) {
+            start.push_back(members.size());
+            members.insert(members.end(), cell.begin(), cell.end());
+        }
+        start.push_back(members.size());
+
+        out.write(grid->cell_of);
+        out.write(start);
+        out.write(members);
+    }
+
+    if (with_events && lists) {
+        // the lists are written the same way as the cells
+        std::vector<uint32_t> start, members;
+
+        for (const std::vector<uint32_t> &list : lists->lists) {
+            start.push_back(members.size());
+            members.insert(members.end(), list.begin(), list.end());
+        }
+        start.push_back(members.size());
+
+        out.write(lists->cx);
+        out.write(lists->cy);
+        out.write(start);
+        out.write(members);
+    }
+
+    // the order of the index follows from the anchors
+    if (with_events && sweep)
+        out.write(sweep->anchor);
+
+    if (with_events) {
+        std::vector<EventRecord> records;
+
+        for (uint32_t slot : events.heap) {
+            const Event &ev = events.slots[slot];
+            EventRecord rec;
+
+            memset(&rec, 0, sizeof(rec));
+            rec.slot = slot;
+            rec.type = static_cast<uint8_t>(ev.type);
+            rec.wtype = static_cast<uint8_t>(ev.wtype);
+            rec.time = ev.time;
+            rec.pa = ev.pa;
+            rec.pb = ev.pb;
+            rec.pa_rev = ev.pa_rev;
+            rec.pb_rev = ev.pb_rev;
+            records.push_back(rec);
+        }
+
+        out.write(records);
+    }
+
+    out.close();
+    if (out.fail())
+        throw CheckpointError(describeError(tmp_path));
+    if (rename(tmp_path.c_str(), path.c_str()) < 0)
+        throw CheckpointError(describeError(path));
+}
+
+std::unique_ptr<Simulation> Checkpoint::load(const std::string &path)
+{
+    Mapping mapping(path);
+    Reader in(mapping.data, mapping.size);
+    Header header = *in.take<Header>(1);
+
+    if (memcmp(header.magic, magic, sizeof(magic)) != 0)
+        throw CheckpointError(path + " is not a checkpoint");
+    if (header.byte_order != byte_order)
+        throw CheckpointError(path + " was saved on a machine with "
+                              "different byte order");
+    if (header.version != version) {
+        throw CheckpointError(path + " has unsupported version " +
+                              std::to_string(header.version));
+    }
+    if (header.scalar != ScalarPolicy<Scalar>::id) {
+        throw CheckpointError(path + " was saved by an engine built for "
+                              "another scalar type, this one uses " +
+                              ScalarPolicy<Scalar>::name());
+    }
+    if (header.width <= 0 || header.height <= 0)
+        throw CheckpointError(path + " has a broken box");
+
+    std::unique_ptr<Simulation> simulation(new Simulation(header.width,
+                                                          header.height));
+    ParticleStore &particles = simulation->particles;
+    uint32_t n = header.nparticles;
+
+    in.read(particles.x, n);
+    in.read(particles.y, n);
+    in.read(particles.t, n);
+    in.read(particles.vx, n);
+    in.read(particles.vy, n);
+    in.read(particles.radius, n);
+    in.read(particles.mass, n);
+    in.read(particles.rev, n);
+    in.read(particles.color, n);
+    particles.checkUniform();
+
+    simulation->now = header.now;
+    simulation->nevents = header.nevents;
+    simulation->nstale = header.nstale;
+    simulation->use_grid = (header.flags & HasGrid) != 0;
+    simulation->hierarchical = (header.flags & FlatGrid) == 0;
+    if (header.flags & HasLists) {
+        if (!(header.skin > 0))
+            throw CheckpointError(path + " has broken neighbor lists");
+        simulation->skin = header.skin;
+    }
+    if (header.flags & HasSweep) {
+        if (!(header.horizon > 0))
+            throw CheckpointError(path + " has a broken sweep index");
+        simulation->horizon = header.horizon;
+    }
+
+    if (header.flags & HasEvents) {
+        if (simulation->use_grid) {
+            // the cells are checked against the size of the file
+            // before the grid allocates them
+            if (header.nlevels < 1 || header.nlevels > 16 ||
+                !(header.cell_size > 0) || !std::isfinite(header.cell_size) ||
+                std::ceil(header.width / header.cell_size) *
+                std::ceil(header.height / header.cell_size) > header.ncells ||
+                header.ncells >= mapping.size / sizeof(uint32_t))
+                throw CheckpointError(path + " has a broken grid");
+
+            Grid *grid = new Grid(header.width, header.height,
+                                  header.cell_size, header.nlevels);
+            const uint32_t *start, *members;
+
+            simulation->grid.reset(grid);
+            if (grid->cells.size() != header.ncells)
+                throw CheckpointError(path + " has a broken grid");
+
+            in.read(grid->cell_of, n);
+            start = in.take<uint32_t>(header.ncells + 1);
+            members = in.take<uint32_t>(n);
+            for (uint32_t c = 0; c < header.ncells; c++) {
+                if (start[c] > start[c + 1] || start[c + 1] > n)
+                    throw CheckpointError(path + " has a broken grid");
+                grid->cells[c].assign(members + start[c],
+                                      members + start[c + 1]);
+            }
+
+            // every particle sits in exactly one cell, the one
+            // cell_of says
+            std::vector<bool> binned(n, false);
+
+            for (uint32_t c = 0; c < header.ncells; c++) {
+                for (uint32_t i : grid->cells[c]) {
+                    if (i >= n || binned[i] || grid->cell_of[i] != (int)c)
+                        throw CheckpointError(path + " has a broken grid");
+                    binned[i] = true;
+                }
+            }
+            if (start[header.ncells] != n)
+                throw CheckpointError(path + " has a broken grid");
+        }
+
+        if (header.flags & HasLists) {
+            NeighborLists *lists = new NeighborLists(header.skin);
+            const uint32_t *start, *members;
+            uint32_t nmembers;
+
+            simulation->lists.reset(lists);
+            in.read(lists->cx, n);
+            in.read(lists->cy, n);
+            start = in.take<uint32_t>(n + 1);
+            nmembers = start[n];
+            members = in.take<uint32_t>(nmembers);
+            lists->lists.resize(n);
+            for (uint32_t i = 0; i < n; i++) {
+                if (start[i] > start[i + 1] || start[i + 1] > nmembers)
+                    throw CheckpointError(path + " has broken neighbor lists");
+                lists->lists[i].assign(members + start[i],
+                                       members + start[i + 1]);
+            }
+
+            // the lists are sorted and symmetric, rebuild relies on that
+            for (uint32_t i = 0; i < n; i++) {
+                const std::vector<uint32_t> &list = lists->lists[i];
+
+                for (size_t k = 0; k < list.size(); k++) {
+                    uint32_t j = list[k];
+
+                    if (j >= n || j == i || (k > 0 && list[k - 1] >= j) ||
+                        !std::binary_search(lists->lists[j].begin(),
+                                            lists->lists[j].end(), i))
+                        throw CheckpointError(path + " has broken neighbor lists");
+                }
+                if (!std::isfinite(lists->cx[i]) || !std::isfinite(lists->cy[i]))
+                    throw CheckpointError(path + " has broken neighbor lists");
+            }
+            lists->bin(particles);
+        }
+
+        if (header.flags & HasSweep) {
+            SweepIndex *sweep = new SweepIndex(header.horizon);
+
+            simulation->sweep.reset(sweep);
+            in.read(sweep->anchor, n);
+            sweep->reindex(particles);
+        }
+
+        EventQueue &events = simulation->events;
+        const EventRecord *records = in.take<EventRecord>(header.nqueued);
+
+        events.reset(n + 1);
+        for (uint32_t k = 0; k < header.nqueued; k++) {
+            const EventRecord &rec = records[k];
+
+            if (!validRecord(rec, header) ||
+                events.get(rec.slot) != nullptr)
+                throw CheckpointError(path + " has a broken event");
+            events.put(rec.slot, Event{rec.time,
+                                       static_cast<EventType>(rec.type),
+                                       static_cast<WallType>(rec.wtype),
+                                       rec.pa, rec.pb,
+                                       rec.pa_rev, rec.pb_rev});
+        }
+        events.heapify();
+        simulation->initialized = true;
+        // observables are not stored, the averages start over
+        simulation->resetObservables();
+    }
+
+    if (!in.atEnd())
+        throw CheckpointError(path + " has trailing data");
+
+    return simulation;
+}
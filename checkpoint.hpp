@@ -0,0 +1,48 @@
+#ifndef _CHECKPOINT_HPP_
+#define _CHECKPOINT_HPP_
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "simulation.hpp"
+
+class CheckpointError : public std::runtime_error {
+public:
+    explicit CheckpointError(const std::string msg) :
+        std::runtime_error(msg) {};
+    virtual ~CheckpointError() {};
+};
+
+/*
+ * Binary snapshot of the whole state of a simulation, so that a long
+ * run can be stopped and resumed later.
+ *
+ * The file starts with a fixed size header (magic, format version,
+ * box size, number of particles, the current time and counters)
+ * followed by the particle arrays exactly as the ParticleStore keeps
+ * them, so it can only be restored by an engine built for the same
+ * scalar type. Optionally it also holds the pending events together with the
+ * grid binning (or the neighbor lists, the sweep index) they were
+ * predicted with: a simulation restored from such a checkpoint plays
+ * exactly the same events as the one it was saved from would have.
+ * Without the events the file is smaller, but the first events have
+ * to be predicted again after restoring.
+ *
+ * Numbers are stored in the byte order of the machine, the header
+ * tells it, so a checkpoint can't be moved between machines of
+ * different endianness.
+ */
+class Checkpoint {
+public:
+    static const uint32_t version = 5;
+
+    // writes the state of @simulation to @path; the file is
+    // replaced only once the new one is completely written
+    static void save(const Simulation &simulation, const std::string &path,
+                     bool with_events = true);
+
+    // creates a simulation from the checkpoint at @path
+    static std::unique_ptr<Simulation> load(const std::string &path);
+};
+
+#endif /* _CHECKPOINT_HPP_ */
@@ -0,0 +1,122 @@
+#include <cmath>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include "ensemble.hpp"
+#include "simulation.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+// what a member reports at every sample
+struct Measurement {
+    double temperature;
+    double pressure;
+    double collision_frequency;
+    double mean_free_path;
+};
+
+EnsembleStat aggregate(const std::vector<double> &values)
+{
+    double sum = 0, square_sum = 0;
+    size_t n = values.size();
+
+    for (double v : values)
+        sum += v;
+
+    double mean = sum / n;
+
+    for (double v : values)
+        square_sum += (v - mean) * (v - mean);
+
+    return EnsembleStat{mean, (n > 1) ? std::sqrt(square_sum / (n - 1)) : 0};
+}
+
+}
+
+Ensemble::Ensemble(int width, int height,
+                   const std::vector<Particle> &particles)
+    : particles(particles)
+{
+    this->width = width;
+    this->height = height;
+    nmembers = 1;
+    seed = 1;
+    perturbation = 0.01;
+    interval = 1;
+    use_grid = false;
+    nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void Ensemble::setThreads(unsigned nthreads)
+{
+    this->nthreads = std::max(nthreads, 1u);
+}
+
+std::vector<Particle> Ensemble::perturbed(unsigned member) const
+{
+    std::mt19937_64 rng(seed + member);
+    std::uniform_real_distribution<double> distribution(-perturbation,
+                                                        perturbation);
+    std::vector<Particle> out(particles);
+
+    for (Particle &p : out)
+        p.rotateVelocity(distribution(rng));
+
+    return out;
+}
+
+std::vector<EnsembleSample> Ensemble::run(double time)
+{
+    size_t nsamples = std::floor(time / interval);
+    std::vector<Measurement> measured(nmembers * nsamples);
+    ThreadPool pool(std::min(nthreads, nmembers));
+
+    pool.run(nmembers, [&](size_t member, unsigned) {
+        Simulation simulation(width, height);
+        Measurement *out = &measured[member * nsamples];
+
+        // the members themselves run in parallel
+        simulation.setThreads(1);
+        if (use_grid)
+            simulation.enableGrid();
+        simulation.addParticles(perturbed(member));
+
+        // the events are predicted and observables start counting
+        // with the first call
+        simulation.nextEventTime();
+
+        for (size_t k = 0; k < nsamples; k++) {
+            Observables &observables = simulation.getObservables();
+
+            simulation.runUntil((k + 1) * interval);
+            out[k] = Measurement{observables.getTemperature(),
+                                 observables.getPressure(),
+                                 observables.getCollisionFrequency(),
+                                 observables.getMeanFreePath()};
+            observables.restart();
+        }
+    });
+
+    std::vector<EnsembleSample> samples(nsamples);
+    std::vector<double> values[4];
+
+    for (size_t k = 0; k < nsamples; k++) {
+        for (std::vector<double> &v : values)
+            v.clear();
+        for (unsigned m = 0; m < nmembers; m++) {
+            const Measurement &mes = measured[m * nsamples + k];
+
+            values[0].push_back(mes.temperature);
+            values[1].push_back(mes.pressure);
+            values[2].push_back(mes.collision_frequency);
+            values[3].push_back(mes.mean_free_path);
+        }
+
+        samples[k] = EnsembleSample{(k + 1) * interval, aggregate(values[0]),
+                                    aggregate(values[1]), aggregate(values[2]),
+                                    aggregate(values[3])};
+    }
+
+    return samples;
+}
@@ -0,0 +1,84 @@
+#ifndef _ENSEMBLE_HPP_
+#define _ENSEMBLE_HPP_
+
+#include <vector>
+#include <cstdint>
+#include "particle.hpp"
+
+// mean and standard deviation of an observable over the ensemble
+struct EnsembleStat {
+    double mean;
+    double sd;
+};
+
+// observables of all the members at one moment of time
+struct EnsembleSample {
+    double time;
+    EnsembleStat temperature;
+    EnsembleStat pressure;
+    EnsembleStat collision_frequency;
+    EnsembleStat mean_free_path;
+};
+
+/*
+ * Runs many independent realizations (members) of the same system and
+ * aggregates their observables.
+ *
+ * Every member starts from the same particles with their velocities
+ * turned by a small random angle (the kinetic energy stays the same),
+ * member k draws the angles from seed + k, so the results do not
+ * depend on the number of threads. Members are handed out to a pool of
+ * threads one by one as threads get free; a member lives only while it
+ * runs, so at most as many simulations as threads exist at a time and
+ * the particles are not copied for the others.
+ *
+ * Observables are sampled every @interval of simulation time; the
+ * averages (pressure etc.) are taken over the interval before a sample.
+ */
+class Ensemble {
+private:
+    int width, height;
+    const std::vector<Particle> &particles;
+    unsigned nmembers;
+    unsigned long seed;
+    double perturbation;
+    double interval;
+    bool use_grid;
+    unsigned nthreads;
+
+    std::vector<Particle> perturbed(unsigned member) const;
+
+public:
+    // @particles are shared by all the members and have to outlive
+    // the ensemble
+    Ensemble(int width, int height, const std::vector<Particle> &particles);
+
+    void setMembers(unsigned n) {
+        nmembers = n;
+    }
+
+    void setSeed(unsigned long seed) {
+        this->seed = seed;
+    }
+
+    // the largest angle (in radians) velocities are turned by
+    void setPerturbation(double angle) {
+        perturbation = angle;
+    }
+
+    void setInterval(double interval) {
+        this->interval = interval;
+    }
+
+    void enableGrid() {
+        use_grid = true;
+    }
+
+    // number of members run at once, all the cores by default
+    void setThreads(unsigned nthreads);
+
+    // runs all the members until @time
+    std::vector<EnsembleSample> run(double time);
+};
+
+#endif /* _ENSEMBLE_HPP_ */
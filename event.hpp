@@ -1,112 +1,81 @@
 #ifndef _EVENT_HPP_
 #define _EVENT_HPP_
 
+#include <cstdint>
 #include "particle.hpp"
 
 /*
- * There're three events we use in the simulation:
+ * There're six events we use in the simulation:
  * - Refresh event: stands for refreshing the screen
  * - Wall collision event: represents the moment a
  *   particle collides with wall
  * - Particle collision event: represents the moment
  *   a particle collides another particle
+ * - Cell crossing event: represents the moment a particle
+ *   moves from one grid cell to another (only used when
+ *   the simulation runs with the grid broadphase)
+ * - List expiry event: represents the moment a particle
+ *   may get closer to the particles not on its neighbor
+ *   list than the list allows (only used with the neighbor
+ *   lists broadphase)
+ * - Interval expiry event: represents the moment a particle
+ *   gets too far along x from where the sweep index put it
+ *   (only used with the sort-and-sweep broadphase)
  */
-enum class EventType {Refresh, WallCollision, ParticleCollision};
+enum class EventType : uint8_t {Refresh, WallCollision, ParticleCollision,
+                                CellCrossing, ListExpiry, IntervalExpiry};
 
-// Basic abstract class for all events
-class Event {
-protected:
+/*
+ * Events are plain records copied by value: there are millions of
+ * them created during a simulation, so they must not cost a heap
+ * allocation each. Particles are referred to by their indices in
+ * the simulation together with the revisions they had when the event
+ * was predicted; an event is stale if any of its particles has
+ * collided something since then.
+ */
+struct Event {
     double time; // the time the event will happen
-    EventType ev_type; // the type of the event
-
-public:
-    explicit Event(double time, EventType type) : time(time), ev_type(type)  {};
-    virtual ~Event() {};
-
-    virtual double getTime() const {
-        return time;
+    EventType type; // the type of the event
+    WallType wtype; // the wall a particle collides (WallCollision)
+    uint32_t pa; // the particle
+    uint32_t pb; // the other particle (ParticleCollision) or
+                 // the cell the particle moves to (CellCrossing)
+    uint32_t pa_rev;
+    uint32_t pb_rev;
+
+    static Event refresh(double time) {
+        return Event{time, EventType::Refresh, WallType::Vertical, 0, 0, 0, 0};
     }
 
-    virtual EventType getType() const {
-        return ev_type;
+    static Event wallCollision(double time, uint32_t p, uint32_t p_rev,
+                               WallType wtype) {
+        return Event{time, EventType::WallCollision, wtype, p, 0, p_rev, 0};
     }
 
-    // returns true if the event is outdated/cancelled
-    virtual bool isStale() const = 0;
-};
-
-class RefreshEvent : public Event {
-public:
-    explicit RefreshEvent(double time) : Event(time, EventType::Refresh) {};
-    virtual ~RefreshEvent() {};
-
-    // this event can not be cancelled
-    bool isStale() const { return false; }
-};
-
-class WallCollisionEvent : public Event {
-protected:
-    Particle *p; // a particle
-    WallType wtype; // the type of wall particle will collide
-    int p_rev;
-
-public:
-    WallCollisionEvent(double time, Particle &p, WallType wtype)
-        : Event(time, EventType::WallCollision) {
-        this->p = &p;
-        this->wtype = wtype;
-        p_rev = p.getRevision();
-    };
-
-    virtual ~WallCollisionEvent() {};
-
-    // the event is considered to be stale if
-    // the particle collides something before
-    bool isStale() const {
-        return (p_rev != p->getRevision());
-    }
-
-    WallType getWallType() const {
-        return wtype;
-    }
-
-    Particle& getParticle() const {
-        return *p;
+    static Event particleCollision(double time, uint32_t pa, uint32_t pa_rev,
+                                   uint32_t pb, uint32_t pb_rev) {
+        return Event{time, EventType::ParticleCollision, WallType::Vertical,
+                     pa, pb, pa_rev, pb_rev};
     }
-};
-
-class ParticleCollisionEvent : public Event {
-protected:
-    Particle *pa;
-    Particle *pb;
-    int pa_rev;
-    int pb_rev;
-
-public:
-    ParticleCollisionEvent(double time, Particle &pa, Particle &pb)
-        : Event(time, EventType::ParticleCollision) {
-        this->pa = &pa;
-        this->pb = &pb;
-        pa_rev = pa.getRevision();
-        pb_rev = pb.getRevision();
-    }
-
-    virtual ~ParticleCollisionEvent() {};
 
-    // the event is considered to be stale if
-    // one of particles collides somethign
-    // before.
-    bool isStale() const {
-        return ((pa_rev != pa->getRevision()) ||
-                (pb_rev != pb->getRevision()));
+    // crossing a cell does not change the trajectory of the
+    // particle, so the event goes stale only if the particle
+    // collides something before it reaches the cell boundary.
+    static Event cellCrossing(double time, uint32_t p, uint32_t p_rev,
+                              uint32_t cell) {
+        return Event{time, EventType::CellCrossing, WallType::Vertical,
+                     p, cell, p_rev, 0};
     }
 
-    Particle &getFirstParticle() const {
-        return *pa;
+    // the same goes for the list and interval expiries
+    static Event listExpiry(double time, uint32_t p, uint32_t p_rev) {
+        return Event{time, EventType::ListExpiry, WallType::Vertical,
+                     p, 0, p_rev, 0};
     }
 
-    Particle &getSecondParticle() const {
-        return *pb;
+    static Event intervalExpiry(double time, uint32_t p, uint32_t p_rev) {
+        return Event{time, EventType::IntervalExpiry, WallType::Vertical,
+                     p, 0, p_rev, 0};
     }
 };
 
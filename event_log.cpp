@@ -0,0 +1,325 @@
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include "event_log.hpp"
+
+namespace {
+
+const char magic[8] = {'P', 'A', 'R', 'T', 'E', 'L', 'O', 'G'};
+const uint32_t byte_order = 0x01020304;
+const uint32_t version = 1;
+
+// records are written in blocks of about that size
+const size_t buffer_size = 1 << 20;
+
+struct Header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t nparticles;
+    int32_t width, height;
+    uint32_t unused;
+};
+
+enum : uint32_t {
+    WallBounce = 1,
+    Collision = 2,
+    Sync = 3,
+};
+
+// followed by the new velocity of @pa (wall bounce)
+// or @pb and the new velocities of both (collision)
+struct RecordHead {
+    double time;
+    uint32_t type;
+    uint32_t pa;
+};
+
+struct CollisionTail {
+    uint32_t pb;
+    uint32_t unused;
+    double vxa, vya, vxb, vyb;
+};
+
+}
+
+EventLogWriter::EventLogWriter(const std::string &path,
+                               const ParticleStore &particles,
+                               int width, int height)
+    : file(path, std::ios::binary | std::ios::trunc), path(path)
+{
+    Header header;
+    uint32_t n = particles.size();
+    std::vector<double> columns[5];
+    std::vector<int32_t> radius, mass;
+    std::vector<uint32_t> color;
+
+    if (file.fail())
+        throw EventLogError(path + ": " + strerror(errno));
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.byte_order = byte_order;
+    header.version = version;
+    header.nparticles = n;
+    header.width = width;
+    header.height = height;
+    put(&header, sizeof(header));
+
+    for (uint32_t i = 0; i < n; i++) {
+        columns[0].push_back(particles.getX(i));
+        columns[1].push_back(particles.getY(i));
+        columns[2].push_back(particles.getTime(i));
+        columns[3].push_back(particles.getVX(i));
+        columns[4].push_back(particles.getVY(i));
+        radius.push_back(particles.getRadius(i));
+        mass.push_back(particles.getMass(i));
+        color.push_back(particles.getColor(i));
+    }
+
+    for (const std::vector<double> &column : columns)
+        put(column.data(), n * sizeof(double));
+    put(radius.data(), n * sizeof(int32_t));
+    put(mass.data(), n * sizeof(int32_t));
+    put(color.data(), n * sizeof(uint32_t));
+
+    nrecords = 0;
+    flush();
+}
+
+EventLogWriter::~EventLogWriter()
+{
+    try {
+        close();
+    }
+    catch (EventLogError &) {
+        // nobody to report it to anymore
+    }
+}
+
+void EventLogWriter::put(const void *data, size_t bytes)
+{
+    const char *p = static_cast<const char *>(data);
+
+    buffer.insert(buffer.end(), p, p + bytes);
+}
+
+void EventLogWriter::flush()
+{
+    file.write(buffer.data(), buffer.size());
+    buffer.clear();
+    if (file.fail())
+        throw EventLogError(path + ": " + strerror(errno));
+}
+
+void EventLogWriter::wallBounce(double time, const ParticleStore &particles,
+                                uint32_t i)
+{
+    RecordHead head = {time, WallBounce, i};
+    double v[2] = {particles.getVX(i), particles.getVY(i)};
+
+    put(&head, sizeof(head));
+    put(v, sizeof(v));
+    nrecords++;
+    if (buffer.size() >= buffer_size)
+        flush();
+}
+
+void EventLogWriter::collision(double time, const ParticleStore &particles,
+                               uint32_t i, uint32_t j)
+{
+    RecordHead head = {time, Collision, i};
+    CollisionTail tail = {j, 0, particles.getVX(i), particles.getVY(i),
+                          particles.getVX(j), particles.getVY(j)};
+
+    put(&head, sizeof(head));
+    put(&tail, sizeof(tail));
+    nrecords++;
+    if (buffer.size() >= buffer_size)
+        flush();
+}
+
+void EventLogWriter::sync(double time)
+{
+    RecordHead head = {time, Sync, 0};
+
+    put(&head, sizeof(head));
+    nrecords++;
+    if (buffer.size() >= buffer_size)
+        flush();
+}
+
+void EventLogWriter::close()
+{
+    if (!file.is_open())
+        return;
+
+    flush();
+    file.close();
+    if (file.fail())
+        throw EventLogError(path + ": " + strerror(errno));
+}
+
+EventReplay::EventReplay(const std::string &path)
+    : file(path, std::ios::binary), path(path), particles(0, 0)
+{
+    Header header;
+
+    if (file.fail())
+        throw EventLogError(path + ": " + strerror(errno));
+
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (file.fail() || memcmp(header.magic, magic, sizeof(magic)) != 0)
+        throw EventLogError(path + " is not an event log");
+    if (header.byte_order != byte_order)
+        throw EventLogError(path + " was written on a machine with "
+                            "different byte order");
+    if (header.version != version) {
+        throw EventLogError(path + " has unsupported version " +
+                            std::to_string(header.version));
+    }
+
+    width = header.width;
+    height = header.height;
+    nparticles = header.nparticles;
+    particles = ParticleStore(width, height);
+    start = file.tellg();
+    rewind();
+}
+
+// reads the initial state again
+void EventReplay::rewind()
+{
+    size_t n = nparticles;
+    std::vector<double> columns[5];
+
+    file.clear();
+    file.seekg(start);
+    for (std::vector<double> &column : columns) {
+        column.resize(n);
+        file.read(reinterpret_cast<char *>(column.data()),
+                  n * sizeof(double));
+    }
+    // the log keeps doubles whatever the engine is built for
+    particles.x.resize(n);
+    particles.y.resize(n);
+    particles.vx.resize(n);
+    particles.vy.resize(n);
+    particles.t = columns[2];
+    for (size_t i = 0; i < n; i++) {
+        particles.x[i] = ScalarPolicy<Scalar>::fromDouble(columns[0][i]);
+        particles.y[i] = ScalarPolicy<Scalar>::fromDouble(columns[1][i]);
+        particles.vx[i] = ScalarPolicy<Scalar>::fromDouble(columns[3][i]);
+        particles.vy[i] = ScalarPolicy<Scalar>::fromDouble(columns[4][i]);
+    }
+    particles.radius.resize(n);
+    particles.mass.resize(n);
+    particles.color.resize(n);
+    file.read(reinterpret_cast<char *>(particles.radius.data()),
+              n * sizeof(int32_t));
+    file.read(reinterpret_cast<char *>(particles.mass.data()),
+              n * sizeof(int32_t));
+    file.read(reinterpret_cast<char *>(particles.color.data()),
+              n * sizeof(uint32_t));
+    if (file.fail())
+        throw EventLogError(path + " is truncated");
+    particles.rev.assign(n, 0);
+    particles.checkUniform();
+
+    now = 0;
+    for (size_t i = 0; i < n; i++)
+        now = std::max(now, particles.t[i]);
+    position = 0;
+}
+
+// Applies the next record, unless @only_before is set and the record
+// comes after @until. Particles are moved with ParticleStore::advance,
+// just like the simulation moved them.
+bool EventReplay::apply(bool only_before, double until)
+{
+    std::streampos at = file.tellg();
+    RecordHead head;
+
+    file.read(reinterpret_cast<char *>(&head), sizeof(head));
+    if (file.gcount() == 0 && file.eof()) {
+        file.clear();
+        file.seekg(at);
+        return false;
+    }
+    if (file.fail())
+        throw EventLogError(path + " is truncated");
+
+    if (only_before && head.time > until) {
+        file.seekg(at);
+        return false;
+    }
+
+    if (head.type == WallBounce) {
+        double v[2];
+
+        file.read(reinterpret_cast<char *>(v), sizeof(v));
+        if (file.fail())
+            throw EventLogError(path + " is truncated");
+        if (head.pa >= particles.size())
+            throw EventLogError(path + " has a broken record");
+
+        particles.advance(head.pa, head.time);
+        particles.vx[head.pa] = ScalarPolicy<Scalar>::fromDouble(v[0]);
+        particles.vy[head.pa] = ScalarPolicy<Scalar>::fromDouble(v[1]);
+        particles.rev[head.pa]++;
+    }
+    else if (head.type == Collision) {
+        CollisionTail tail;
+
+        file.read(reinterpret_cast<char *>(&tail), sizeof(tail));
+        if (file.fail())
+            throw EventLogError(path + " is truncated");
+        if (head.pa >= particles.size() || tail.pb >= particles.size())
+            throw EventLogError(path + " has a broken record");
+
+        particles.advance(head.pa, head.time);
+        particles.advance(tail.pb, head.time);
+        particles.vx[head.pa] = ScalarPolicy<Scalar>::fromDouble(tail.vxa);
+        particles.vy[head.pa] = ScalarPolicy<Scalar>::fromDouble(tail.vya);
+        particles.vx[tail.pb] = ScalarPolicy<Scalar>::fromDouble(tail.vxb);
+        particles.vy[tail.pb] = ScalarPolicy<Scalar>::fromDouble(tail.vyb);
+        particles.rev[head.pa]++;
+        particles.rev[tail.pb]++;
+    }
+    else if (head.type == Sync) {
+        for (uint32_t i = 0; i < particles.size(); i++)
+            particles.advance(i, head.time);
+    }
+    else {
+        throw EventLogError(path + " has a broken record");
+    }
+
+    now = head.time;
+    position++;
+    return true;
+}
+
+bool EventReplay::step()
+{
+    return apply(false, 0);
+}
+
+uint64_t EventReplay::seek(uint64_t n)
+{
+    if (n < position)
+        rewind();
+    while (position < n && apply(false, 0))
+        ;
+
+    return position;
+}
+
+uint64_t EventReplay::seekTime(double time)
+{
+    if (time < now)
+        rewind();
+    while (apply(true, time))
+        ;
+
+    return position;
+}
@@ -0,0 +1,125 @@
+#ifndef _EVENT_LOG_HPP_
+#define _EVENT_LOG_HPP_
+
+#include <vector>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+#include "particle_store.hpp"
+
+class EventLogError : public std::runtime_error {
+public:
+    explicit EventLogError(const std::string msg) :
+        std::runtime_error(msg) {};
+    virtual ~EventLogError() {};
+};
+
+/*
+ * Event log file format.
+ *
+ * The file starts with a header (magic, byte order, version, number
+ * of particles, box size) and the state of all particles at the time
+ * the log was opened, exactly as the ParticleStore keeps it (including
+ * the times the particles were last moved at). Records of the events
+ * that changed the state follow one after another:
+ * - a wall bounce: time, particle, its new velocity
+ * - a collision: time, both particles, their new velocities
+ * - a sync: time, all the particles were moved to it
+ * Cell crossings and stale events change nothing, so they are not
+ * logged. Replaying the records moves particles with exactly the same
+ * arithmetic the simulation did, so the replayed state is bit for bit
+ * the one the simulation had.
+ */
+
+/*
+ * Writes the events processed by a simulation to a file, see
+ * Simulation::setEventLog. Records are collected in a buffer and
+ * written in large blocks.
+ */
+class EventLogWriter {
+private:
+    std::ofstream file;
+    std::string path;
+    std::vector<char> buffer;
+    uint64_t nrecords;
+
+    void put(const void *data, size_t bytes);
+    void flush();
+
+public:
+    EventLogWriter(const std::string &path, const ParticleStore &particles,
+                   int width, int height);
+    ~EventLogWriter();
+
+    void wallBounce(double time, const ParticleStore &particles, uint32_t i);
+    void collision(double time, const ParticleStore &particles,
+                   uint32_t i, uint32_t j);
+    void sync(double time);
+
+    // writes the rest of the buffer and closes the file
+    void close();
+
+    uint64_t getRecordCount() const {
+        return nrecords;
+    }
+};
+
+/*
+ * Rebuilds the states of a logged simulation by applying the records
+ * of the log one by one, without predicting anything. Going forward is
+ * a few arithmetic operations per record; going back starts over from
+ * the beginning of the log.
+ */
+class EventReplay {
+private:
+    std::ifstream file;
+    std::string path;
+    int width, height;
+    size_t nparticles;
+    ParticleStore particles;
+    std::streampos start; // of the records
+    double now;
+    uint64_t position;
+
+    void rewind();
+    bool apply(bool only_before, double until);
+
+public:
+    explicit EventReplay(const std::string &path);
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    // the time of the last applied record; positions of particles
+    // which were last moved earlier are given by getX/getY(i, time)
+    double getTime() const {
+        return now;
+    }
+
+    // number of records applied so far
+    uint64_t getPosition() const {
+        return position;
+    }
+
+    const ParticleStore &getParticles() const {
+        return particles;
+    }
+
+    // applies the next record, false at the end of the log
+    bool step();
+
+    // brings the state to the one after the first @n records
+    // (or all of them, if there are fewer); returns the position
+    uint64_t seek(uint64_t n);
+
+    // applies all the records up to @time (but not later)
+    uint64_t seekTime(double time);
+};
+
+#endif /* _EVENT_LOG_HPP_ */
@@ -0,0 +1,207 @@
+#include "event_queue.hpp"
+
+bool SlotHeap::less(uint32_t slot_a, uint32_t slot_b) const
+{
+    double time_a = slots[slot_a].time;
+    double time_b = slots[slot_b].time;
+
+    return (time_a < time_b) || (time_a == time_b && slot_a < slot_b);
+}
+
+void SlotHeap::place(size_t pos, uint32_t slot)
+{
+    heap[pos] = slot;
+    position[slot] = pos;
+}
+
+void SlotHeap::siftUp(size_t pos)
+{
+    uint32_t slot = heap[pos];
+
+    while (pos > 0) {
+        size_t parent = (pos - 1) / 2;
+
+        if (!less(slot, heap[parent]))
+            break;
+
+        place(pos, heap[parent]);
+        pos = parent;
+    }
+
+    place(pos, slot);
+}
+
+void SlotHeap::siftDown(size_t pos)
+{
+    uint32_t slot = heap[pos];
+    size_t n = heap.size();
+
+    while (true) {
+        size_t child = 2 * pos + 1;
+
+        if (child >= n)
+            break;
+        if (child + 1 < n && less(heap[child + 1], heap[child]))
+            child++;
+        if (!less(heap[child], slot))
+            break;
+
+        place(pos, heap[child]);
+        pos = child;
+    }
+
+    place(pos, slot);
+}
+
+void SlotHeap::update(uint32_t slot)
+{
+    if (position[slot] < 0) {
+        heap.push_back(slot);
+        siftUp(heap.size() - 1);
+    }
+    else {
+        // the new event may be either earlier or later than the old one
+        siftUp(position[slot]);
+        siftDown(position[slot]);
+    }
+}
+
+void SlotHeap::detach(uint32_t slot)
+{
+    size_t pos = position[slot];
+    uint32_t last = heap.back();
+
+    heap.pop_back();
+    position[slot] = -1;
+    if (last == slot)
+        return;
+
+    place(pos, last);
+    siftUp(pos);
+    siftDown(position[last]);
+}
+
+void SlotHeap::append(uint32_t slot)
+{
+    if (position[slot] < 0) {
+        position[slot] = heap.size();
+        heap.push_back(slot);
+    }
+}
+
+void SlotHeap::heapify()
+{
+    for (size_t pos = heap.size() / 2; pos-- > 0; )
+        siftDown(pos);
+}
+
+EventQueue::EventQueue(size_t nslots)
+{
+    reset(nslots);
+}
+
+void EventQueue::reset(size_t nslots)
+{
+    slots.resize(nslots);
+    position.assign(nslots, -1);
+    heap.clear();
+    heap.reserve(nslots);
+    peak_size = 0;
+}
+
+size_t EventQueue::memoryUsage() const
+{
+    return slots.capacity() * sizeof(Event) +
+        heap.capacity() * sizeof(uint32_t) +
+        position.capacity() * sizeof(int64_t);
+}
+
+Event EventQueue::pop()
+{
+    uint32_t slot = heap.front();
+
+    slotHeap().detach(slot);
+    return slots[slot];
+}
+
+void EventQueue::update(uint32_t slot, const Event &ev)
+{
+    slots[slot] = ev;
+    slotHeap().update(slot);
+    if (heap.size() > peak_size)
+        peak_size = heap.size();
+}
+
+void EventQueue::put(uint32_t slot, const Event &ev)
+{
+    slots[slot] = ev;
+    slotHeap().append(slot);
+}
+
+void EventQueue::heapify()
+{
+    slotHeap().heapify();
+    if (heap.size() > peak_size)
+        peak_size = heap.size();
+}
+
+void EventQueue::remove(uint32_t slot)
+{
+    if (position[slot] >= 0)
+        slotHeap().detach(slot);
+}
+
+void EventQueueSet::reset(size_t nslots, size_t nqueues)
+{
+    slots.resize(nslots);
+    position.assign(nslots, -1);
+    owner.assign(nslots, 0);
+    heaps.assign(nqueues, std::vector<uint32_t>());
+}
+
+Event EventQueueSet::pop(uint32_t queue)
+{
+    uint32_t slot = heaps[queue].front();
+
+    slotHeap(queue).detach(slot);
+    return slots[slot];
+}
+
+void EventQueueSet::update(uint32_t slot, const Event &ev)
+{
+    slots[slot] = ev;
+    slotHeap(owner[slot]).update(slot);
+}
+
+void EventQueueSet::remove(uint32_t slot)
+{
+    if (position[slot] >= 0)
+        slotHeap(owner[slot]).detach(slot);
+}
+
+void EventQueueSet::setOwner(uint32_t slot, uint32_t queue)
+{
+    if (owner[slot] == queue)
+        return;
+
+    if (position[slot] < 0) {
+        owner[slot] = queue;
+        return;
+    }
+
+    slotHeap(owner[slot]).detach(slot);
+    owner[slot] = queue;
+    slotHeap(queue).update(slot);
+}
+
+void EventQueueSet::put(uint32_t slot, const Event &ev)
+{
+    slots[slot] = ev;
+    slotHeap(owner[slot]).append(slot);
+}
+
+void EventQueueSet::heapify()
+{
+    for (uint32_t queue = 0; queue < heaps.size(); queue++)
+        slotHeap(queue).heapify();
+}
@@ -0,0 +1,187 @@
+#ifndef _EVENT_QUEUE_HPP_
+#define _EVENT_QUEUE_HPP_
+
+#include <vector>
+#include "event.hpp"
+
+/*
+ * The heap both queues below are built on: a binary min-heap of slot
+ * numbers kept in a vector of the caller, with the position of every
+ * slot in a reverse index (-1 for the slots not in any heap). Slots are
+ * ordered by the times of their events, ties are broken by the slot
+ * number. It owns nothing, the queues make one for every operation.
+ */
+class SlotHeap {
+private:
+    std::vector<uint32_t> &heap;
+    std::vector<int64_t> &position;
+    const std::vector<Event> &slots;
+
+    bool less(uint32_t slot_a, uint32_t slot_b) const;
+    void place(size_t pos, uint32_t slot);
+    void siftUp(size_t pos);
+    void siftDown(size_t pos);
+
+public:
+    SlotHeap(std::vector<uint32_t> &heap, std::vector<int64_t> &position,
+             const std::vector<Event> &slots)
+        : heap(heap), position(position), slots(slots) {}
+
+    // puts the slot to the heap, or to its new place
+    // if it's there already and its event has changed
+    void update(uint32_t slot);
+
+    // takes the slot out of the heap
+    void detach(uint32_t slot);
+
+    // appends the slot without keeping the heap in order
+    void append(uint32_t slot);
+
+    // puts the whole heap in order in O(n)
+    void heapify();
+};
+
+/*
+ * Addressable priority queue of events.
+ *
+ * The queue has a fixed number of slots and keeps at most one pending
+ * event per slot: the simulation uses a slot per particle (holding the
+ * earliest event predicted for it) plus a few slots for the events not
+ * bound to any particle. Putting a new event to a slot replaces the old
+ * one, so cancelled events do not pile up in the queue and its size
+ * never exceeds the number of slots.
+ *
+ * Internally it's a SlotHeap of all the slots. Events themselves are
+ * stored by value in the slots, so the queue does not allocate
+ * anything after it's been reset. Events are ordered by time, ties
+ * are broken by the slot number, so the order in which events come
+ * out of the queue does not depend on the order they were put in.
+ */
+class EventQueue {
+private:
+    // saves and restores the state directly
+    friend class Checkpoint;
+
+    std::vector<Event> slots; // the pending event of each slot
+    std::vector<uint32_t> heap; // slots arranged as a binary heap
+    std::vector<int64_t> position; // position of each slot in the heap
+    size_t peak_size; // the largest size the queue ever had
+
+    SlotHeap slotHeap() {
+        return SlotHeap(heap, position, slots);
+    }
+
+public:
+    explicit EventQueue(size_t nslots = 0);
+    ~EventQueue() {};
+
+    // changes the number of slots, all the events are dropped
+    void reset(size_t nslots);
+
+    bool empty() const {
+        return heap.empty();
+    }
+
+    size_t size() const {
+        return heap.size();
+    }
+
+    size_t getPeakSize() const {
+        return peak_size;
+    }
+
+    // bytes allocated by the queue
+    size_t memoryUsage() const;
+
+    // the earliest event in the queue and its slot
+    const Event &top() const {
+        return slots[heap.front()];
+    }
+
+    uint32_t topSlot() const {
+        return heap.front();
+    }
+
+    // the pending event of the slot (nullptr if there's none)
+    const Event *get(uint32_t slot) const {
+        return (position[slot] < 0) ? nullptr : &slots[slot];
+    }
+
+    // removes the earliest event from the queue
+    Event pop();
+
+    // puts the event to the slot replacing the one
+    // the slot held before (if any)
+    void update(uint32_t slot, const Event &ev);
+
+    // drops the pending event of the slot (if any)
+    void remove(uint32_t slot);
+
+    // Bulk loading: put() stores the event to the slot without
+    // keeping the heap in order, heapify() puts the whole heap in
+    // order at once in O(n). No other method may be called between
+    // the two.
+    void put(uint32_t slot, const Event &ev);
+    void heapify();
+};
+
+/*
+ * A set of event queues sharing one array of slots, every slot belongs
+ * to exactly one of the queues at a time. It's what the parallel engine
+ * keeps its regions' events in: each region has queues of its own, so
+ * the threads working on different regions never touch the same heap,
+ * while any particle can still be looked up (and moved to another
+ * region) by its global slot number. The queues are SlotHeaps, so the
+ * events come out in the same order as from EventQueue.
+ */
+class EventQueueSet {
+private:
+    std::vector<Event> slots;
+    std::vector<int64_t> position; // position of each slot in its heap
+    std::vector<uint32_t> owner; // the queue each slot belongs to
+    std::vector<std::vector<uint32_t>> heaps;
+
+    SlotHeap slotHeap(uint32_t queue) {
+        return SlotHeap(heaps[queue], position, slots);
+    }
+
+public:
+    EventQueueSet() {};
+    ~EventQueueSet() {};
+
+    // drops all the events, all the slots go to queue 0
+    void reset(size_t nslots, size_t nqueues);
+
+    bool empty(uint32_t queue) const {
+        return heaps[queue].empty();
+    }
+
+    const Event &top(uint32_t queue) const {
+        return slots[heaps[queue].front()];
+    }
+
+    uint32_t topSlot(uint32_t queue) const {
+        return heaps[queue].front();
+    }
+
+    const Event *get(uint32_t slot) const {
+        return (position[slot] < 0) ? nullptr : &slots[slot];
+    }
+
+    uint32_t getOwner(uint32_t slot) const {
+        return owner[slot];
+    }
+
+    // moves the slot (and its pending event) to another queue
+    void setOwner(uint32_t slot, uint32_t queue);
+
+    Event pop(uint32_t queue);
+    void update(uint32_t slot, const Event &ev);
+    void remove(uint32_t slot);
+
+    // bulk loading, see EventQueue
+    void put(uint32_t slot, const Event &ev);
+    void heapify();
+};
+
+#endif /* _EVENT_QUEUE_HPP_ */
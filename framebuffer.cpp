@@ -0,0 +1,71 @@
+#include <cstdlib>
+#include <algorithm>
+#include "framebuffer.hpp"
+
+Framebuffer::Framebuffer(int width, int height)
+    : pixels((size_t)width * height)
+{
+    this->width = width;
+    this->height = height;
+}
+
+void Framebuffer::clear(uint32_t color)
+{
+    std::fill(pixels.begin(), pixels.end(), color);
+}
+
+// Half widths of the rows of a disk, from the middle one down to the
+// edge. They are taken from the same midpoint (Bresenham) circle the
+// outline of a disk used to be drawn with.
+const std::vector<int> &Framebuffer::getSpans(int radius)
+{
+    if ((size_t)radius >= spans.size())
+        spans.resize(radius + 1);
+
+    std::vector<int> &half = spans[radius];
+
+    if (!half.empty())
+        return half;
+
+    int x = 0, y = radius, d = 3 - 2 * radius;
+
+    half.assign(radius + 1, 0);
+    while (x <= y) {
+        half[y] = std::max(half[y], x);
+        half[x] = std::max(half[x], y);
+
+        if (d <= 0)
+            d += 4 * x + 6;
+        else {
+            d += 4 * (x - y) + 10;
+            y--;
+        }
+
+        x++;
+    }
+
+    return half;
+}
+
+void Framebuffer::fillDisk(int x0, int y0, int radius, uint32_t color)
+{
+    if (radius < 0 || x0 + radius < 0 || x0 - radius >= width ||
+        y0 + radius < 0 || y0 - radius >= height)
+        return;
+
+    const std::vector<int> &half = getSpans(radius);
+    int first = std::max(y0 - radius, 0);
+    int last = std::min(y0 + radius, height - 1);
+
+    for (int y = first; y <= last; y++) {
+        int h = half[std::abs(y - y0)];
+        int left = std::max(x0 - h, 0);
+        int right = std::min(x0 + h, width - 1);
+
+        if (left <= right) {
+            uint32_t *row = &pixels[(size_t)y * width];
+
+            std::fill(row + left, row + right + 1, color);
+        }
+    }
+}
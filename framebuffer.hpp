@@ -0,0 +1,51 @@
+#ifndef _FRAMEBUFFER_HPP_
+#define _FRAMEBUFFER_HPP_
+
+#include <vector>
+#include <cstdint>
+
+/*
+ * Image of the simulation drawn by the CPU, ready to be uploaded to a
+ * texture in one go. Pixels are 32-bit ARGB, rows follow each other
+ * without any padding.
+ *
+ * Disks are filled row by row: the half width of every row of a disk
+ * of a given radius is computed once and reused for all the disks of
+ * that radius, so drawing a disk costs about as much as writing its
+ * pixels.
+ */
+class Framebuffer {
+private:
+    int width, height;
+    std::vector<uint32_t> pixels;
+    std::vector<std::vector<int>> spans; // by radius
+
+    const std::vector<int> &getSpans(int radius);
+
+public:
+    Framebuffer(int width, int height);
+
+    void clear(uint32_t color);
+
+    // disks sticking out of the frame are clipped
+    void fillDisk(int x0, int y0, int radius, uint32_t color);
+
+    const uint32_t *getPixels() const {
+        return pixels.data();
+    }
+
+    // bytes per row
+    int getPitch() const {
+        return width * sizeof(uint32_t);
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+};
+
+#endif /* _FRAMEBUFFER_HPP_ */
@@ -0,0 +1,289 @@
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
+#include "generator.hpp"
+#include "simulation.hpp"
+
+namespace {
+
+// particles are kept a bit apart, so that rounding of coordinates
+// converted to the relative ones and back can't make them overlap
+const double gap = 0.01;
+
+// random packing gives up after so many failures to place a particle
+const int max_attempts = 1000;
+
+std::vector<double> parseSpec(const std::string &spec, size_t min_args,
+                              size_t max_args)
+{
+    std::istringstream iss(spec);
+    std::string part;
+    std::vector<double> args;
+
+    std::getline(iss, part, ':'); // the name of the generator
+    while (std::getline(iss, part, ':')) {
+        char *end;
+
+        args.push_back(strtod(part.c_str(), &end));
+        if (part.empty() || *end != '\0')
+            throw SimulationError("Bad generator " + spec);
+    }
+    if (args.size() < min_args || args.size() > max_args)
+        throw SimulationError("Bad generator " + spec);
+
+    return args;
+}
+
+}
+
+Generator::Generator(int width, int height, unsigned long seed)
+    : rng(seed), distribution(0.0, 1.0)
+{
+    this->width = width;
+    this->height = height;
+}
+
+std::vector<int> Generator::randomRadii(size_t n, double radius,
+                                        double polydispersity)
+{
+    std::vector<int> radii(n);
+
+    for (int &r : radii) {
+        double spread = (2 * uniform() - 1) * polydispersity;
+
+        r = std::max(1, (int)std::round(radius * (1 + spread)));
+    }
+
+    return radii;
+}
+
+Particle Generator::make(double x, double y, int radius, int mass,
+                         double max_speed, int r, int g, int b)
+{
+    double mid = (width + height) / 2.0;
+    double angle = 2 * M_PI * uniform();
+    double speed = max_speed * uniform();
+
+    return Particle(x / width, y / height,
+                    speed * std::cos(angle) / mid,
+                    speed * std::sin(angle) / mid,
+                    radius / mid, mass, width, height, r, g, b);
+}
+
+std::vector<Particle> Generator::lattice(size_t n, double radius,
+                                         double polydispersity,
+                                         double max_speed)
+{
+    std::vector<int> radii = randomRadii(n, radius, polydispersity);
+    std::vector<Particle> out;
+
+    if (n == 0)
+        return out;
+
+    int max_radius = *std::max_element(radii.begin(), radii.end());
+    int ncols = std::ceil(std::sqrt((double)n * width / height));
+    int nrows = (n + ncols - 1) / ncols;
+    double xspacing = (double)width / ncols;
+    double yspacing = (double)height / nrows;
+
+    if (std::min(xspacing, yspacing) < 2 * max_radius) {
+        throw SimulationError("Particles are too dense to be placed "
+                              "on a lattice");
+    }
+
+    out.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        int r = radii[i];
+        double xjitter = std::max(xspacing / 2 - r - gap, 0.0);
+        double yjitter = std::max(yspacing / 2 - r - gap, 0.0);
+        double x = (i % ncols + 0.5) * xspacing +
+            (2 * uniform() - 1) * xjitter;
+        double y = (i / ncols + 0.5) * yspacing +
+            (2 * uniform() - 1) * yjitter;
+
+        out.push_back(make(x, y, r, std::min(r, 100), max_speed, 0, 0, 200));
+    }
+
+    return out;
+}
+
+// Puts particles at random places of the box one by one, a place is
+// taken if the particle does not overlap any of the particles placed
+// before. The placed particles are binned into a grid of cells as
+// large as the biggest particle, so only adjacent cells are searched.
+// The particles already in @out (a few large ones) are avoided too.
+void Generator::pack(std::vector<Particle> &out, double density,
+                     double radius, double polydispersity, double max_speed)
+{
+    double area = (double)width * height;
+
+    for (const Particle &p : out)
+        area -= M_PI * p.getRadius() * p.getRadius();
+
+    size_t n = std::max(area, 0.0) * density /
+        meanArea(radius, polydispersity);
+    std::vector<int> radii = randomRadii(n, radius, polydispersity);
+
+    if (n == 0)
+        return;
+
+    // the large particles are much easier to place first
+    std::sort(radii.begin(), radii.end(), std::greater<int>());
+
+    double cell_size = 2 * radii[0] + gap;
+    int ncols = std::max(1, (int)std::ceil(width / cell_size));
+    int nrows = std::max(1, (int)std::ceil(height / cell_size));
+    std::vector<int32_t> head(ncols * nrows, -1), next;
+    std::vector<double> xs, ys;
+    std::vector<int> placed_radii;
+    size_t nobstacles = out.size();
+
+    auto fits = [&](double x, double y, int r) {
+        int col = std::min((int)(x / cell_size), ncols - 1);
+        int row = std::min((int)(y / cell_size), nrows - 1);
+
+        for (size_t k = 0; k < nobstacles; k++) {
+            double dx = out[k].getX() - x, dy = out[k].getY() - y;
+            double min_dist = out[k].getRadius() + r + gap;
+
+            if (dx * dx + dy * dy < min_dist * min_dist)
+                return false;
+        }
+
+        for (int nr = std::max(row - 1, 0);
+             nr <= std::min(row + 1, nrows - 1); nr++) {
+            for (int nc = std::max(col - 1, 0);
+                 nc <= std::min(col + 1, ncols - 1); nc++) {
+                for (int32_t j = head[nr * ncols + nc]; j >= 0; j = next[j]) {
+                    double dx = xs[j] - x, dy = ys[j] - y;
+                    double min_dist = placed_radii[j] + r + gap;
+
+                    if (dx * dx + dy * dy < min_dist * min_dist)
+                        return false;
+                }
+            }
+        }
+
+        return true;
+    };
+
+    for (int r : radii) {
+        int attempt;
+        double x = 0, y = 0;
+
+        if (2 * (r + gap) > std::min(width, height))
+            throw SimulationError("Particles do not fit into the box");
+
+        for (attempt = 0; attempt < max_attempts; attempt++) {
+            x = r + gap + uniform() * (width - 2 * (r + gap));
+            y = r + gap + uniform() * (height - 2 * (r + gap));
+            if (fits(x, y, r))
+                break;
+        }
+        if (attempt == max_attempts) {
+            std::ostringstream oss;
+
+            oss << "Random packing got stuck at density "
+                << density * xs.size() / n << ", try the lattice instead";
+            throw SimulationError(oss.str());
+        }
+
+        int cell = std::min((int)(y / cell_size), nrows - 1) * ncols +
+            std::min((int)(x / cell_size), ncols - 1);
+
+        next.push_back(head[cell]);
+        head[cell] = xs.size();
+        xs.push_back(x);
+        ys.push_back(y);
+        placed_radii.push_back(r);
+    }
+
+    out.reserve(out.size() + n);
+    for (size_t k = 0; k < n; k++) {
+        int r = placed_radii[k];
+
+        out.push_back(make(xs[k], ys[k], r, std::min(r, 100), max_speed,
+                           0, 0, 200));
+    }
+}
+
+std::vector<Particle> Generator::randomPacking(double density, double radius,
+                                               double polydispersity,
+                                               double max_speed)
+{
+    std::vector<Particle> out;
+
+    pack(out, density, radius, polydispersity, max_speed);
+    return out;
+}
+
+std::vector<Particle> Generator::tracer(double density, double radius,
+                                        int tracer_radius, int tracer_mass,
+                                        double max_speed)
+{
+    std::vector<Particle> out;
+    double mid = (width + height) / 2.0;
+
+    if (2 * tracer_radius > std::min(width, height))
+        throw SimulationError("Tracer does not fit into the box");
+
+    out.push_back(Particle(0.5, 0.5, 0.0, 0.0, tracer_radius / mid,
+                           tracer_mass, width, height, 200, 0, 0));
+    pack(out, density, radius, 0.0, max_speed);
+
+    return out;
+}
+
+double Generator::meanArea(double radius, double polydispersity)
+{
+    // radii are uniformly distributed around the mean one
+    double d = radius * polydispersity;
+
+    return M_PI * (radius * radius + d * d / 3);
+}
+
+bool Generator::isSpec(const std::string &spec)
+{
+    for (const char *name : {"lattice:", "random:", "tracer:"}) {
+        if (spec.compare(0, strlen(name), name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+std::vector<Particle> Generator::fromSpec(const std::string &spec)
+{
+    std::string name = spec.substr(0, spec.find(':'));
+    std::vector<double> args;
+
+    if (name == "lattice") {
+        args = parseSpec(spec, 2, 3);
+        if (args[0] < 1 || args[1] <= 0 || (args.size() > 2 &&
+                                            (args[2] < 0 || args[2] >= 1)))
+            throw SimulationError("Bad generator " + spec);
+        return lattice(args[0], args[1], (args.size() > 2) ? args[2] : 0.0,
+                       2 * args[1]);
+    }
+    else if (name == "random") {
+        args = parseSpec(spec, 2, 3);
+        if (args[0] <= 0 || args[0] >= 1 || args[1] <= 0 ||
+            (args.size() > 2 && (args[2] < 0 || args[2] >= 1)))
+            throw SimulationError("Bad generator " + spec);
+        return randomPacking(args[0], args[1],
+                             (args.size() > 2) ? args[2] : 0.0, 2 * args[1]);
+    }
+    else if (name == "tracer") {
+        args = parseSpec(spec, 3, 4);
+        if (args[0] <= 0 || args[0] >= 1 || args[1] <= 0 || args[2] < 1 ||
+            (args.size() > 3 && (args[3] < 1 || args[3] > 100)))
+            throw SimulationError("Bad generator " + spec);
+        return tracer(args[0], args[1], args[2],
+                      (args.size() > 3) ? args[3] : 100, 2 * args[1]);
+    }
+
+    throw SimulationError("Unknown generator " + spec);
+}
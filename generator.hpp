@@ -0,0 +1,73 @@
+#ifndef _GENERATOR_HPP_
+#define _GENERATOR_HPP_
+
+#include <vector>
+#include <string>
+#include <random>
+#include "particle.hpp"
+
+/*
+ * Builds systems of particles from a few parameters instead of a
+ * configuration file. The particles never overlap and are ready to be
+ * passed to Simulation::addParticles.
+ *
+ * Radii are spread uniformly by @polydispersity (a fraction of the
+ * mean @radius) around the mean one and rounded to whole pixels, the
+ * mass of a particle equals its radius but is capped at 100 (the
+ * largest mass a configuration file takes, so a generated system can
+ * be written out and loaded again). Every particle moves in a random
+ * direction at a random speed up to @max_speed.
+ *
+ * The same seed always gives the same system.
+ */
+class Generator {
+private:
+    int width, height;
+    std::mt19937_64 rng;
+    std::uniform_real_distribution<double> distribution;
+
+    double uniform() {
+        return distribution(rng);
+    }
+
+    std::vector<int> randomRadii(size_t n, double radius,
+                                 double polydispersity);
+    Particle make(double x, double y, int radius, int mass,
+                  double max_speed, int r, int g, int b);
+    void pack(std::vector<Particle> &out, double density, double radius,
+              double polydispersity, double max_speed);
+
+public:
+    Generator(int width, int height, unsigned long seed);
+
+    // @n particles on a square lattice covering the box,
+    // each one shifted at random within its lattice cell.
+    std::vector<Particle> lattice(size_t n, double radius,
+                                  double polydispersity, double max_speed);
+
+    // Random sequential packing: particles are put one by one at random
+    // places until they cover @density of the box. It can't get much
+    // denser than 0.5, use the lattice for denser systems.
+    std::vector<Particle> randomPacking(double density, double radius,
+                                        double polydispersity,
+                                        double max_speed);
+
+    // A heavy particle resting in the middle of the box and a bath of
+    // small ones around it (Brownian motion, like configs/brownian).
+    std::vector<Particle> tracer(double density, double radius,
+                                 int tracer_radius, int tracer_mass,
+                                 double max_speed);
+
+    // the mean area of a particle (before the radii are rounded)
+    static double meanArea(double radius, double polydispersity);
+
+    // Generators can be given instead of a configuration file as
+    //   lattice:<particles>:<radius>[:<polydispersity>]
+    //   random:<density>:<radius>[:<polydispersity>]
+    //   tracer:<density>:<radius>:<tracer radius>[:<tracer mass>]
+    // particles move at up to twice their mean radius per unit of time.
+    static bool isSpec(const std::string &spec);
+    std::vector<Particle> fromSpec(const std::string &spec);
+};
+
+#endif /* _GENERATOR_HPP_ */
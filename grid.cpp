@@ -0,0 +1,175 @@
+#include <cmath>
+#include <algorithm>
+#include "grid.hpp"
+
+Grid::Grid(int width, int height, double cell_size, int nlevels)
+{
+    int ncols = std::max(1, (int)std::ceil(width / cell_size));
+    int nrows = std::max(1, (int)std::ceil(height / cell_size));
+    int first = 0;
+
+    // A cell of level k covers 2^k x 2^k cells of the lowest one, so
+    // a particle is binned by its cell at the lowest level, whatever
+    // level it belongs to; the levels never disagree on where it is.
+    for (int k = 0; k < nlevels; k++) {
+        Level level = {std::ldexp(cell_size, k), ((ncols - 1) >> k) + 1,
+                       ((nrows - 1) >> k) + 1, first};
+
+        levels.push_back(level);
+        first += level.ncols * level.nrows;
+    }
+
+    cells.resize(first);
+}
+
+int Grid::clampColumn(double x) const
+{
+    return std::min(std::max((int)std::floor(x / levels[0].cell_size), 0),
+                    levels[0].ncols - 1);
+}
+
+int Grid::clampRow(double y) const
+{
+    return std::min(std::max((int)std::floor(y / levels[0].cell_size), 0),
+                    levels[0].nrows - 1);
+}
+
+int Grid::levelOf(int cell) const
+{
+    int k = levels.size() - 1;
+
+    while (cell < levels[k].first)
+        k--;
+    return k;
+}
+
+size_t Grid::memoryUsage() const
+{
+    size_t bytes = cells.capacity() * sizeof(cells[0]) +
+        cell_of.capacity() * sizeof(int);
+
+    for (const std::vector<uint32_t> &cell : cells)
+        bytes += cell.capacity() * sizeof(uint32_t);
+    return bytes;
+}
+
+void Grid::insert(const ParticleStore &particles, uint32_t i)
+{
+    int k = 0;
+
+    while (k + 1 < (int)levels.size() &&
+           levels[k].cell_size < 2.0 * particles.getRadius(i))
+        k++;
+
+    const Level &level = levels[k];
+    int cell = level.first + (clampRow(particles.getY(i)) >> k) * level.ncols +
+        (clampColumn(particles.getX(i)) >> k);
+
+    if (cell_of.size() <= i)
+        cell_of.resize(i + 1, -1);
+
+    cells[cell].push_back(i);
+    cell_of[i] = cell;
+}
+
+void Grid::detach(uint32_t i)
+{
+    std::vector<uint32_t> &cell = cells[cell_of[i]];
+
+    // the order of particles within a cell does not matter,
+    // so just put the last one in place of the removed one.
+    for (size_t k = 0; k < cell.size(); k++) {
+        if (cell[k] == i) {
+            cell[k] = cell.back();
+            cell.pop_back();
+            break;
+        }
+    }
+}
+
+void Grid::move(uint32_t i, int cell)
+{
+    detach(i);
+    cells[cell].push_back(i);
+    cell_of[i] = cell;
+}
+
+double Grid::predictCrossing(const ParticleStore &particles, uint32_t i,
+                             int &to_cell) const
+{
+    const Level &level = levels[levelOf(cell_of[i])];
+    int ncols = level.ncols, nrows = level.nrows;
+    int col = (cell_of[i] - level.first) % ncols;
+    int row = (cell_of[i] - level.first) / ncols;
+    double cell_size = level.cell_size;
+    double x = particles.getX(i), y = particles.getY(i);
+    double vx = particles.getVX(i), vy = particles.getVY(i);
+    double tx = -1.0, ty = -1.0;
+
+    // The particle can not leave the box, so there are no crossings
+    // through the outer sides of the border cells. The position might
+    // be a tiny bit past the boundary because of rounding errors; such
+    // a crossing is due immediately.
+    if (vx > 0.0 && col < ncols - 1)
+        tx = std::max(((col + 1) * cell_size - x) / vx, 0.0);
+    else if (vx < 0.0 && col > 0)
+        tx = std::max((col * cell_size - x) / vx, 0.0);
+
+    if (vy > 0.0 && row < nrows - 1)
+        ty = std::max(((row + 1) * cell_size - y) / vy, 0.0);
+    else if (vy < 0.0 && row > 0)
+        ty = std::max((row * cell_size - y) / vy, 0.0);
+
+    if (tx < 0 && ty < 0)
+        return -1.0;
+
+    if (ty < 0 || (tx >= 0 && tx <= ty)) {
+        to_cell = level.first + row * ncols + col + (vx > 0.0 ? 1 : -1);
+        return particles.getTime(i) + tx;
+    }
+
+    to_cell = level.first + (row + (vy > 0.0 ? 1 : -1)) * ncols + col;
+    return particles.getTime(i) + ty;
+}
+
+void Grid::neighbors(int cell, std::vector<uint32_t> &out) const
+{
+    int k = levelOf(cell);
+    int col = (cell - levels[k].first) % levels[k].ncols;
+    int row = (cell - levels[k].first) / levels[k].ncols;
+
+    for (int m = 0; m < (int)levels.size(); m++) {
+        const Level &level = levels[m];
+        int col_min, col_max, row_min, row_max;
+
+        if (m <= k) {
+            // the cells of level m making the 3x3 block of level k
+            int scale = 1 << (k - m);
+
+            col_min = (col - 1) * scale;
+            col_max = (col + 2) * scale - 1;
+            row_min = (row - 1) * scale;
+            row_max = (row + 2) * scale - 1;
+        }
+        else {
+            // the 3x3 block around the cell of level m holding this one
+            col_min = (col >> (m - k)) - 1;
+            col_max = (col >> (m - k)) + 1;
+            row_min = (row >> (m - k)) - 1;
+            row_max = (row >> (m - k)) + 1;
+        }
+
+        col_min = std::max(col_min, 0);
+        col_max = std::min(col_max, level.ncols - 1);
+        row_min = std::max(row_min, 0);
+        row_max = std::min(row_max, level.nrows - 1);
+
+        for (int r = row_min; r <= row_max; r++) {
+            for (int c = col_min; c <= col_max; c++) {
+                const std::vector<uint32_t> &members =
+                    cells[level.first + r * level.ncols + c];
+                out.insert(out.end(), members.begin(), members.end());
+            }
+        }
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef _GRID_HPP_
+#define _GRID_HPP_
+
+#include <vector>
+#include <cstdint>
+#include "particle_store.hpp"
+
+/*
+ * Uniform grid used as a broadphase for collision prediction.
+ *
+ * The simulation box is split into square cells which are at least
+ * as large as the diameter of the biggest particle. Two particles can
+ * only touch each other when they sit in the same or in adjacent cells,
+ * so a particle has to be tested only against the particles binned
+ * into the 3x3 block of cells around its own one.
+ *
+ * When the radii differ a lot, cells that large would hold many small
+ * particles each, so the grid has several levels: the cells of every
+ * level are twice as large as the ones of the level below and the
+ * particles are binned into the lowest level whose cells are at least
+ * as large as their diameter. The neighbors of a particle are then the
+ * particles of its own level in the 3x3 block around its cell, those of
+ * the lower levels within the same block, and those of the higher
+ * levels in the 3x3 block around the cell its own cell lies in. So a
+ * big particle is tested against the small ones close to it only and
+ * a small one against the big ones which can actually reach it.
+ *
+ * Particles are binned by their position at the moment they are
+ * inserted. After that the binning is kept correct by cell crossing
+ * events: the simulation asks the grid when a particle is going to
+ * leave its cell and moves it to the next cell when that happens.
+ */
+class Grid {
+private:
+    // saves and restores the state directly
+    friend class Checkpoint;
+    // undoes moves made speculatively
+    friend class ParallelEngine;
+
+    struct Level {
+        double cell_size;
+        int ncols, nrows;
+        int first; // the index of its first cell
+    };
+
+    // the lowest level comes first, the cells of all the
+    // levels are kept together
+    std::vector<Level> levels;
+    std::vector<std::vector<uint32_t>> cells;
+
+    // the cell each particle is binned into
+    std::vector<int> cell_of;
+
+    int clampColumn(double x) const;
+    int clampRow(double y) const;
+    int levelOf(int cell) const;
+    void detach(uint32_t i);
+
+public:
+    // the cells of the lowest level are @cell_size large
+    Grid(int width, int height, double cell_size, int nlevels = 1);
+    ~Grid() {};
+
+    double getCellSize() const {
+        return levels[0].cell_size;
+    }
+
+    int getLevels() const {
+        return levels.size();
+    }
+
+    int getCell(uint32_t i) const {
+        return cell_of[i];
+    }
+
+    // columns of the grid of a single level
+    int getColumns() const {
+        return levels[0].ncols;
+    }
+
+    int getColumn(int cell) const {
+        return cell % levels[0].ncols;
+    }
+
+    // puts particle @i to the cell it currently resides in,
+    // at the level its radius belongs to
+    void insert(const ParticleStore &particles, uint32_t i);
+
+    // moves particle @i to another cell
+    void move(uint32_t i, int cell);
+
+    // get the time at which particle @i leaves its cell; the cell
+    // it enters is returned via @to_cell.
+    double predictCrossing(const ParticleStore &particles, uint32_t i,
+                           int &to_cell) const;
+
+    // bytes allocated by the grid
+    size_t memoryUsage() const;
+
+    // appends all the particles which may touch a particle binned into
+    // @cell (the particle itself included) to @out, see above.
+    void neighbors(int cell, std::vector<uint32_t> &out) const;
+};
+
+#endif /* _GRID_HPP_ */
@@ -0,0 +1,516 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <exception>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include "simulation.hpp"
+#include "pconfig.hpp"
+#include "checkpoint.hpp"
+#include "trajectory.hpp"
+#include "generator.hpp"
+#include "event_log.hpp"
+#include "parallel_engine.hpp"
+
+static void usage(const char *appname)
+{
+    std::cerr << "Usage: " << appname << " [-g | -N <skin> | -W <horizon>] [-j <threads>] "
+        "(-t <time> | -e <events>) [-o <file> [-B]] [-s <checkpoint> [-i <time>] "
+        "[-x]] [-T <trajectory> [-f <time>] [-U]] [-R <time>] [-P <time>] [-J <trace>] [-L <log>] "
+        "[-S <seed>] [-D <regions>] "
+        "(-r <checkpoint> | <width> <height> <config>)" << std::endl;
+    std::cerr << "  <config> is a configuration file or one of generators"
+              << std::endl;
+    std::cerr << "    lattice:<particles>:<radius>[:<polydispersity>]"
+              << std::endl;
+    std::cerr << "    random:<density>:<radius>[:<polydispersity>]"
+              << std::endl;
+    std::cerr << "    tracer:<density>:<radius>:<tracer radius>"
+              << "[:<tracer mass>]" << std::endl;
+    std::cerr << "  -g: use the grid broadphase to predict collisions"
+              << std::endl;
+    std::cerr << "  -N: use neighbor lists with the given skin to predict "
+              << "collisions" << std::endl;
+    std::cerr << "  -W: sort and sweep the particles along x with the given "
+              << "horizon to predict collisions" << std::endl;
+    std::cerr << "  -j: number of threads predicting the initial events "
+              << "(all cores by default)" << std::endl;
+    std::cerr << "  -t: run until the given simulation time" << std::endl;
+    std::cerr << "  -e: run until the given number of events is processed"
+              << std::endl;
+    std::cerr << "  -o: write the final state of particles to the file "
+              << "(- for stdout)" << std::endl;
+    std::cerr << "  -B: write the state in the binary config format"
+              << std::endl;
+    std::cerr << "  -s: save a checkpoint to the file at the end" << std::endl;
+    std::cerr << "  -i: also save the checkpoint every given interval "
+              << "of simulation time (with -t)" << std::endl;
+    std::cerr << "  -x: do not save pending events to the checkpoint, "
+              << "they are predicted again on restore" << std::endl;
+    std::cerr << "  -r: restore the simulation from the checkpoint "
+              << "(-g, -N and -W are ignored then)" << std::endl;
+    std::cerr << "  -T: write positions and velocities of particles to the "
+              << "trajectory file (with -t)" << std::endl;
+    std::cerr << "  -f: simulation time between frames of the trajectory "
+              << "(default 1)" << std::endl;
+    std::cerr << "  -U: do not compress the trajectory" << std::endl;
+    std::cerr << "  -R: report temperature, pressure etc. every given "
+              << "interval of simulation time (with -t)" << std::endl;
+    std::cerr << "  -P: print counters and timers of the engine every given "
+              << "interval of simulation time (with -t) and at the end"
+              << std::endl;
+    std::cerr << "  -J: record the timed phases of the engine to the file "
+              << "as a Chrome trace" << std::endl;
+    std::cerr << "  -L: log every event changing the state to the file, "
+              << "see replay" << std::endl;
+    std::cerr << "  -S: seed of the generator (default 1)" << std::endl;
+    std::cerr << "  -D: split the box into the given number of regions "
+              << "played by threads of their own (implies -g, not with "
+              << "-R and -L)" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+// One line of observables averaged over the time since the
+// previous report.
+static void report(std::ostream &os, Simulation &simulation, double time)
+{
+    Observables &observables = simulation.getObservables();
+    std::ios_base::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+
+    os << std::setprecision(6)
+       << "time " << time
+       << " energy " << observables.getKineticEnergy()
+       << " temperature " << observables.getTemperature()
+       << " pressure " << observables.getPressure()
+       << " collision_frequency " << observables.getCollisionFrequency()
+       << " mean_free_path " << observables.getMeanFreePath()
+       << std::endl;
+    os.flags(flags);
+    os.precision(precision);
+    observables.restart();
+}
+
+// The final state is written in the configuration file format,
+// so it can be used as a starting point of another simulation.
+static std::vector<PConfigEntry> get_state(const Simulation &simulation)
+{
+    const ParticleStore &particles = simulation.getParticles();
+    double width = simulation.getWidth(), height = simulation.getHeight();
+    double mid = (width + height) / 2;
+    std::vector<PConfigEntry> entries(particles.size());
+
+    for (uint32_t i = 0; i < particles.size(); i++) {
+        PConfigEntry &entry = entries[i];
+        uint32_t color = particles.getColor(i);
+
+        entry.rx = particles.getX(i) / width;
+        entry.ry = particles.getY(i) / height;
+        entry.vx = particles.getVX(i) / mid;
+        entry.vy = particles.getVY(i) / mid;
+        entry.mass = particles.getMass(i);
+        entry.radius = particles.getRadius(i) / mid;
+        entry.r = color >> 16;
+        entry.g = (color >> 8) & 0xff;
+        entry.b = color & 0xff;
+    }
+
+    return entries;
+}
+
+static void write_state(std::ostream &os, const Simulation &simulation)
+{
+    os << "# state at " << simulation.getTime() << std::endl;
+    os << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (const PConfigEntry &entry : get_state(simulation)) {
+        os << entry.rx << " " << entry.ry << " " << entry.vx << " "
+           << entry.vy << " " << entry.mass << " " << entry.radius << " "
+           << entry.r << " " << entry.g << " " << entry.b << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool use_grid = false;
+    double until_time = -1.0;
+    long long until_events = -1;
+    const char *output = nullptr;
+    bool binary_output = false;
+    const char *checkpoint = nullptr, *restore = nullptr;
+    double interval = -1.0;
+    bool with_events = true;
+    const char *trajectory = nullptr;
+    double frame_interval = 1.0;
+    bool compress = true;
+    unsigned nthreads = 0;
+    unsigned long seed = 1;
+    double report_interval = -1.0;
+    double stats_interval = -1.0;
+    const char *trace = nullptr;
+    const char *event_log = nullptr;
+    unsigned nregions = 0;
+    double skin = 0.0;
+    double horizon = 0.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "gN:W:j:t:e:o:Bs:i:xr:T:f:UR:P:J:L:S:D:")) != -1) {
+        switch (opt) {
+        case 'g':
+            use_grid = true;
+            break;
+        case 'N':
+            skin = strtod(optarg, NULL);
+            if (skin <= 0) {
+                std::cerr << "Skin has to be positive" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'W':
+            horizon = strtod(optarg, NULL);
+            if (horizon <= 0) {
+                std::cerr << "Horizon has to be positive" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'j':
+            nthreads = strtoul(optarg, NULL, 10);
+            break;
+        case 't':
+            until_time = strtod(optarg, NULL);
+            break;
+        case 'e':
+            until_events = strtoll(optarg, NULL, 10);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case 'B':
+            binary_output = true;
+            break;
+        case 's':
+            checkpoint = optarg;
+            break;
+        case 'i':
+            interval = strtod(optarg, NULL);
+            break;
+        case 'x':
+            with_events = false;
+            break;
+        case 'r':
+            restore = optarg;
+            break;
+        case 'T':
+            trajectory = optarg;
+            break;
+        case 'f':
+            frame_interval = strtod(optarg, NULL);
+            break;
+        case 'U':
+            compress = false;
+            break;
+        case 'R':
+            report_interval = strtod(optarg, NULL);
+            break;
+        case 'P':
+            stats_interval = strtod(optarg, NULL);
+            break;
+        case 'J':
+            trace = optarg;
+            break;
+        case 'L':
+            event_log = optarg;
+            break;
+        case 'S':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            nregions = strtoul(optarg, NULL, 10);
+            use_grid = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != (restore ? 0 : 3))
+        usage(argv[0]);
+    if ((until_time < 0) == (until_events < 0)) {
+        std::cerr << "Either time (-t) or number of events (-e) "
+                  << "has to be given" << std::endl;
+        usage(argv[0]);
+    }
+    if (interval >= 0 && (checkpoint == nullptr || until_time < 0)) {
+        std::cerr << "Checkpoint interval (-i) requires -s and -t"
+                  << std::endl;
+        usage(argv[0]);
+    }
+    if (interval == 0) {
+        std::cerr << "Checkpoint interval has to be positive" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (trajectory != nullptr && until_time < 0) {
+        std::cerr << "Trajectory (-T) requires -t" << std::endl;
+        usage(argv[0]);
+    }
+    if (report_interval >= 0 && until_time < 0) {
+        std::cerr << "Reports (-R) require -t" << std::endl;
+        usage(argv[0]);
+    }
+    if (report_interval == 0) {
+        std::cerr << "Report interval has to be positive" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (nregions > 0 && (report_interval >= 0 || event_log != nullptr)) {
+        std::cerr << "Reports (-R) and the event log (-L) can not be used "
+                  << "with regions (-D)" << std::endl;
+        usage(argv[0]);
+    }
+    if ((skin > 0) + (horizon > 0) + use_grid > 1) {
+        std::cerr << "Only one of the grid (-g, -D), neighbor lists (-N) "
+                  << "and the sweep (-W) can be used" << std::endl;
+        usage(argv[0]);
+    }
+    if (stats_interval >= 0 && until_time < 0)
+        stats_interval = 0; // only at the end
+    if (frame_interval <= 0) {
+        std::cerr << "Frame interval has to be positive" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    try {
+        std::unique_ptr<Simulation> sim;
+
+        if (restore != nullptr) {
+            sim = Checkpoint::load(restore);
+        }
+        else {
+            int width = strtol(argv[optind], NULL, 10);
+            int height = strtol(argv[optind + 1], NULL, 10);
+
+            if (width <= 0 || height <= 0) {
+                std::cerr << "Width/height have to be positive" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+
+            std::string config = argv[optind + 2];
+            std::vector<Particle> batch;
+
+            sim.reset(new Simulation(width, height));
+            // the regions are strips of the grid of a single level
+            if (use_grid)
+                sim->enableGrid(nregions == 0);
+            if (skin > 0)
+                sim->enableNeighborLists(skin);
+            if (horizon > 0)
+                sim->enableSweep(horizon);
+            if (nthreads > 0)
+                sim->setThreads(nthreads);
+
+            if (Generator::isSpec(config)) {
+                batch = Generator(width, height, seed).fromSpec(config);
+            }
+            else {
+                PConfig cfg(config.c_str());
+                std::vector<PConfigEntry> entries = cfg.readAll(nthreads);
+
+                batch.reserve(entries.size());
+                for (const PConfigEntry &entry : entries) {
+                    batch.push_back(Particle(entry.rx, entry.ry,
+                                             entry.vx, entry.vy,
+                                             entry.radius, entry.mass,
+                                             width, height,
+                                             entry.r, entry.g, entry.b));
+                }
+            }
+
+            sim->addParticles(batch);
+        }
+
+        Simulation &simulation = *sim;
+
+        if (nthreads > 0)
+            simulation.setThreads(nthreads);
+
+        // about 24 MB of records
+        if (trace != nullptr)
+            simulation.getStats().startTrace(1 << 20);
+        if (stats_interval >= 0)
+            simulation.getStats().setDetailedTiming(true);
+
+        std::unique_ptr<EventLogWriter> log;
+
+        if (event_log != nullptr) {
+            log.reset(new EventLogWriter(event_log, simulation.getParticles(),
+                                         simulation.getWidth(),
+                                         simulation.getHeight()));
+            simulation.setEventLog(log.get());
+        }
+
+        std::unique_ptr<TrajectoryWriter> writer;
+
+        if (trajectory != nullptr) {
+            writer.reset(new TrajectoryWriter(trajectory,
+                                              simulation.getParticles(),
+                                              simulation.getWidth(),
+                                              simulation.getHeight(),
+                                              frame_interval, compress));
+        }
+
+        // the engine plays the events of the simulation in place
+        std::unique_ptr<ParallelEngine> engine;
+
+        if (nregions > 0)
+            engine.reset(new ParallelEngine(simulation, nregions));
+
+        auto run_until = [&](double time) {
+            if (engine)
+                engine->runUntil(time);
+            else
+                simulation.runUntil(time);
+        };
+
+        auto advance = [&](double time) {
+            if (engine)
+                engine->advance(time);
+            else
+                simulation.advance(time);
+        };
+
+        auto start = std::chrono::steady_clock::now();
+        double begin = simulation.getTime();
+        uint64_t nframes = 0, nsaves = 1, nreports = 1, nstats = 1;
+
+        if (until_events >= 0 && engine)
+            engine->run(until_events);
+        else if (until_events >= 0)
+            simulation.run(until_events);
+
+        // Frames, reports and checkpoints are taken without moving the
+        // particles (the store keeps the clock of every particle), so
+        // they do not change the simulation and a run resumed from a
+        // checkpoint plays exactly the same events as the one that was
+        // not stopped. Only the final state is brought to @until_time,
+        // after the last checkpoint is saved.
+        while (until_events < 0) {
+            double frame_at = writer ?
+                begin + nframes * frame_interval : until_time + 1;
+            double save_at = (interval > 0) ?
+                begin + nsaves * interval : until_time;
+            double report_at = (report_interval > 0) ?
+                begin + nreports * report_interval : until_time + 1;
+            double stats_at = (stats_interval > 0) ?
+                begin + nstats * stats_interval : until_time + 1;
+
+            if (report_at <= std::min({stats_at, frame_at, save_at,
+                                       until_time})) {
+                run_until(report_at);
+                report(std::cout, simulation, report_at);
+                nreports++;
+            }
+            else if (stats_at <= std::min({frame_at, save_at, until_time})) {
+                run_until(stats_at);
+                simulation.printStats(std::cerr);
+                nstats++;
+            }
+            else if (frame_at <= std::min(save_at, until_time)) {
+                run_until(frame_at);
+                writer->write(simulation.getParticles(), frame_at);
+                nframes++;
+            }
+            else if (save_at < until_time) {
+                run_until(save_at);
+                Checkpoint::save(simulation, checkpoint, with_events);
+                nsaves++;
+            }
+            else {
+                run_until(until_time);
+                if (checkpoint != nullptr)
+                    Checkpoint::save(simulation, checkpoint, with_events);
+                advance(until_time);
+                break;
+            }
+        }
+
+        if (writer)
+            writer->close();
+        if (log) {
+            simulation.setEventLog(nullptr);
+            log->close();
+        }
+        if (stats_interval >= 0) {
+            simulation.printStats(std::cerr);
+            if (engine)
+                engine->printStats(std::cerr);
+        }
+        if (trace != nullptr)
+            simulation.getStats().writeTrace(trace);
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        // with -t it's saved before the particles are moved
+        if (checkpoint != nullptr && until_events >= 0)
+            Checkpoint::save(simulation, checkpoint, with_events);
+
+        if (output != nullptr && binary_output) {
+            PConfig::writeBinary(output, get_state(simulation));
+        }
+        else if (output != nullptr) {
+            if (std::string(output) == "-") {
+                write_state(std::cout, simulation);
+            }
+            else {
+                std::ofstream ofile(output);
+
+                if (ofile.fail())
+                    throw std::ios_base::failure(strerror(errno));
+                write_state(ofile, simulation);
+            }
+        }
+
+        std::cerr << "particles: " << simulation.getParticles().size()
+                  << std::endl;
+        std::cerr << "simulation time: " << simulation.getTime() << std::endl;
+        std::cerr << "events: " << simulation.getEventCount() << std::endl;
+        std::cerr << "wall time: " << elapsed.count() << " s" << std::endl;
+        std::cerr << "throughput: "
+                  << simulation.getEventCount() / elapsed.count()
+                  << " events/s" << std::endl;
+    }
+    catch (PConfigError &e) {
+        std::cerr << "Configuration file error: [l: " << e.getLine()
+                  << ", c: " << e.getColumn() << "]: " << e.what() << std::endl;
+        std::cerr << "Format: " << PConfig::formatString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (TrajectoryError &e) {
+        std::cerr << "Trajectory error: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (EventLogError &e) {
+        std::cerr << "Event log error: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (CheckpointError &e) {
+        std::cerr << "Checkpoint error: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (SimulationError &e) {
+        std::cerr << "Simulation error: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
@@ -2,28 +2,52 @@
 #include <memory>
 #include <exception>
 #include <cstdlib>
+#include <unistd.h>
 #include <SDL2/SDL.h>
 
 #include "simulation.hpp"
+#include "viewer.hpp"
 #include "pconfig.hpp"
+#include "generator.hpp"
 
 static const int default_fps = 100;
 
 static void usage(const char *appname)
 {
     std::cerr << "Usage: " << appname <<
-        " <width> <height> <config>" << std::endl;
+        " [-g] [-S <seed>] <width> <height> <config>" << std::endl;
+    std::cerr << "  -g: use the grid broadphase to predict collisions"
+              << std::endl;
+    std::cerr << "  -S: seed of the generator given instead of the config "
+              << "(see headless)" << std::endl;
     exit(EXIT_FAILURE);
 }
 
-static void print_speed(int speed)
+static void print_speed(double speed)
 {
     std::cout << "Speed: " << speed << "x" << std::endl;
 }
 
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
+    bool use_grid = false;
+    unsigned long seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "gS:")) != -1) {
+        switch (opt) {
+        case 'g':
+            use_grid = true;
+            break;
+        case 'S':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 3)
         usage(argv[0]);
 
 
@@ -39,8 +63,8 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    int width = strtol(argv[1], NULL, 10);
-    int height = strtol(argv[2], NULL, 10);
+    int width = strtol(argv[optind], NULL, 10);
+    int height = strtol(argv[optind + 1], NULL, 10);
 
     if (width < 200 || height < 200) {
         std::cerr << "Width/height can not be less than 200" << std::endl;
@@ -58,58 +82,91 @@ int main(int argc, char *argv[])
     }
 
     try {
-        PConfig cfg(argv[3]);
-        Simulation simulation(width, height, default_fps);
+        std::string config = argv[optind + 2];
+        std::vector<Particle> batch;
+        Simulation simulation(width, height);
 
-        while (true) {
-            std::unique_ptr<PConfigEntry> entry = cfg.nextEntry();
+        if (use_grid)
+            simulation.enableGrid();
 
-            if (entry == nullptr)
-                break;
-
-            simulation.addParticle(entry->rx, entry->ry, entry->vx, entry->vy,
-                                   entry->radius, entry->mass,
-                                   entry->r, entry->g, entry->b);
+        if (Generator::isSpec(config)) {
+            batch = Generator(width, height, seed).fromSpec(config);
+        }
+        else {
+            PConfig cfg(config.c_str());
+            std::vector<PConfigEntry> entries = cfg.readAll();
+
+            batch.reserve(entries.size());
+            for (const PConfigEntry &entry : entries) {
+                batch.push_back(Particle(entry.rx, entry.ry,
+                                         entry.vx, entry.vy,
+                                         entry.radius, entry.mass,
+                                         width, height,
+                                         entry.r, entry.g, entry.b));
+            }
         }
 
-        while (true) {
+        simulation.addParticles(batch);
+
+        // the viewer has to be gone before SDL is shut down
+        Viewer viewer(simulation, default_fps);
+        bool running = true;
+
+        while (running && viewer.playing()) {
             SDL_Event event;
-            while (SDL_PollEvent(&event)) {
+            while (running && SDL_PollEvent(&event)) {
                 switch (event.type) {
                 case SDL_QUIT:
-                    SDL_Quit();
-                    return 0;
+                    running = false;
+                    break;
 
                 case SDL_KEYDOWN:
                     switch (event.key.keysym.sym) {
                     case SDLK_SPACE:
-                        if (simulation.paused()) {
+                        if (viewer.paused()) {
                             std::cout << "Resumed" << std::endl;
-                            simulation.resume();
+                            viewer.resume();
                         }
                         else {
                             std::cout << "Paused" << std::endl;
-                            simulation.pause();
+                            viewer.pause();
                         }
 
                         break;
 
                     case SDLK_UP:
-                        simulation.incSpeed();
-                        print_speed(simulation.getSpeed());
+                        viewer.incSpeed();
+                        print_speed(viewer.getSpeed());
                         break;
 
                     case SDLK_DOWN:
-                        simulation.decSpeed();
-                        print_speed(simulation.getSpeed());
+                        viewer.decSpeed();
+                        print_speed(viewer.getSpeed());
+                        break;
+
+                    case SDLK_f:
+                        viewer.toggleFastForward();
+                        if (viewer.fastForwarding())
+                            std::cout << "Fast forward" << std::endl;
+                        else
+                            print_speed(viewer.getSpeed());
                         break;
                     }
                 }
 
             }
 
-            simulation.tick();
+            // the simulation is played by the viewer's own thread,
+            // this one only draws what it publishes
+            if (running && !viewer.show())
+                SDL_Delay(1);
         }
+
+        viewer.close();
+        simulation.printStats(std::cerr);
+        std::cerr << "frames " << viewer.getStats().getCalls(Phase::Refresh)
+                  << " refresh_s " << viewer.getStats().getTime(Phase::Refresh)
+                  << std::endl;
     }
     catch (PConfigError &e) {
         std::cerr << "Configuration file error: [l: " << e.getLine()
@@ -126,5 +183,6 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    SDL_Quit();
     exit(EXIT_SUCCESS);
 }
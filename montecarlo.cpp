@@ -0,0 +1,164 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "ensemble.hpp"
+#include "simulation.hpp"
+#include "pconfig.hpp"
+#include "generator.hpp"
+
+/*
+ * Runs an ensemble of realizations of one system in a single process
+ * and prints the observables averaged over the ensemble as CSV.
+ */
+
+static void usage(const char *appname)
+{
+    std::cerr << "Usage: " << appname << " [-g] [-j <threads>] "
+        "[-n <members>] [-s <seed>] [-p <angle>] [-f <time>] -t <time> "
+        "<width> <height> <config>" << std::endl;
+    std::cerr << "  -g: use the grid broadphase to predict collisions"
+              << std::endl;
+    std::cerr << "  -j: number of members run at once "
+              << "(all cores by default)" << std::endl;
+    std::cerr << "  -n: number of members (default 16)" << std::endl;
+    std::cerr << "  -s: seed of the perturbations (default 1), also "
+              << "used by generators" << std::endl;
+    std::cerr << "  -p: largest angle velocities are turned by, in radians "
+              << "(default 0.01)" << std::endl;
+    std::cerr << "  -f: simulation time between samples (default 1)"
+              << std::endl;
+    std::cerr << "  -t: run every member until the given simulation time"
+              << std::endl;
+    std::cerr << "  <config> is a configuration file or a generator, "
+              << "see headless" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+    bool use_grid = false;
+    unsigned nthreads = 0;
+    unsigned nmembers = 16;
+    unsigned long seed = 1;
+    double perturbation = 0.01;
+    double interval = 1.0;
+    double until_time = -1.0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "gj:n:s:p:f:t:")) != -1) {
+        switch (opt) {
+        case 'g':
+            use_grid = true;
+            break;
+        case 'j':
+            nthreads = strtoul(optarg, NULL, 10);
+            break;
+        case 'n':
+            nmembers = strtoul(optarg, NULL, 10);
+            break;
+        case 's':
+            seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'p':
+            perturbation = strtod(optarg, NULL);
+            break;
+        case 'f':
+            interval = strtod(optarg, NULL);
+            break;
+        case 't':
+            until_time = strtod(optarg, NULL);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 3 || until_time < 0)
+        usage(argv[0]);
+    if (nmembers == 0 || interval <= 0) {
+        std::cerr << "Number of members and sample interval "
+                  << "have to be positive" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    int width = strtol(argv[optind], NULL, 10);
+    int height = strtol(argv[optind + 1], NULL, 10);
+
+    if (width <= 0 || height <= 0) {
+        std::cerr << "Width/height have to be positive" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    try {
+        std::string config = argv[optind + 2];
+        std::vector<Particle> particles;
+
+        // parsed once and shared by all the members
+        if (Generator::isSpec(config)) {
+            particles = Generator(width, height, seed).fromSpec(config);
+        }
+        else {
+            PConfig cfg(config.c_str());
+
+            for (const PConfigEntry &entry : cfg.readAll(nthreads)) {
+                particles.push_back(Particle(entry.rx, entry.ry,
+                                             entry.vx, entry.vy,
+                                             entry.radius, entry.mass,
+                                             width, height,
+                                             entry.r, entry.g, entry.b));
+            }
+        }
+
+        Ensemble ensemble(width, height, particles);
+
+        ensemble.setMembers(nmembers);
+        ensemble.setSeed(seed);
+        ensemble.setPerturbation(perturbation);
+        ensemble.setInterval(interval);
+        if (use_grid)
+            ensemble.enableGrid();
+        if (nthreads > 0)
+            ensemble.setThreads(nthreads);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<EnsembleSample> samples = ensemble.run(until_time);
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        std::cout << "time,temperature,temperature_sd,pressure,pressure_sd,"
+                  << "collision_frequency,collision_frequency_sd,"
+                  << "mean_free_path,mean_free_path_sd" << std::endl;
+        for (const EnsembleSample &s : samples) {
+            std::cout << s.time << ","
+                      << s.temperature.mean << "," << s.temperature.sd << ","
+                      << s.pressure.mean << "," << s.pressure.sd << ","
+                      << s.collision_frequency.mean << ","
+                      << s.collision_frequency.sd << ","
+                      << s.mean_free_path.mean << ","
+                      << s.mean_free_path.sd << std::endl;
+        }
+
+        std::cerr << "members: " << nmembers << std::endl;
+        std::cerr << "wall time: " << elapsed.count() << " s" << std::endl;
+    }
+    catch (PConfigError &e) {
+        std::cerr << "Configuration file error: [l: " << e.getLine()
+                  << ", c: " << e.getColumn() << "]: " << e.what() << std::endl;
+        std::cerr << "Format: " << PConfig::formatString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (SimulationError &e) {
+        std::cerr << "Simulation error: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
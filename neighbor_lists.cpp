@@ -0,0 +1,168 @@
+#include <cmath>
+#include <algorithm>
+#include "neighbor_lists.hpp"
+
+NeighborLists::NeighborLists(double skin)
+{
+    this->skin = skin;
+}
+
+bool NeighborLists::near(const ParticleStore &particles, uint32_t i,
+                         uint32_t j) const
+{
+    double dx = cx[i] - cx[j], dy = cy[i] - cy[j];
+    double reach = particles.getRadius(i) + particles.getRadius(j) + skin;
+
+    return (dx * dx + dy * dy <= reach * reach);
+}
+
+size_t NeighborLists::memoryUsage() const
+{
+    size_t bytes = (cx.capacity() + cy.capacity()) * sizeof(double) +
+        lists.capacity() * sizeof(lists[0]) +
+        bins.capacity() * sizeof(bins[0]) +
+        bin_of.capacity() * sizeof(uint32_t);
+
+    for (const std::vector<uint32_t> &list : lists)
+        bytes += list.capacity() * sizeof(uint32_t);
+    for (const std::vector<uint32_t> &members : bins)
+        bytes += members.capacity() * sizeof(uint32_t);
+    return bytes;
+}
+
+// Centers out of the area the bins were laid over (a particle the
+// list was rebuilt for may have its center anywhere) go to the edge
+// bins, which keeps the neighbors in adjacent bins.
+int NeighborLists::binOf(double x, double y) const
+{
+    double fx = (x - min_x) / bin_size, fy = (y - min_y) / bin_size;
+    int col = (fx >= 0) ? static_cast<int>(std::min(fx, ncols - 1.0)) : 0;
+    int row = (fy >= 0) ? static_cast<int>(std::min(fy, nrows - 1.0)) : 0;
+
+    return row * ncols + col;
+}
+
+void NeighborLists::bin(const ParticleStore &particles)
+{
+    uint32_t n = cx.size();
+    double max_x = 0, max_y = 0;
+
+    min_x = min_y = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (i == 0 || cx[i] < min_x)
+            min_x = cx[i];
+        if (i == 0 || cx[i] > max_x)
+            max_x = cx[i];
+        if (i == 0 || cy[i] < min_y)
+            min_y = cy[i];
+        if (i == 0 || cy[i] > max_y)
+            max_y = cy[i];
+    }
+
+    // a little larger than the reach, so the rounding can't put
+    // two particles in reach two bins apart
+    bin_size = std::max((2.0 * particles.getMaxRadius() + skin) * 1.001, 1.0);
+    // no more bins than particles, a few particles in a huge box
+    // don't need millions of empty bins
+    while ((std::floor((max_x - min_x) / bin_size) + 1) *
+           (std::floor((max_y - min_y) / bin_size) + 1) > std::max(n, 1u))
+        bin_size *= 2;
+    ncols = static_cast<int>((max_x - min_x) / bin_size) + 1;
+    nrows = static_cast<int>((max_y - min_y) / bin_size) + 1;
+
+    bins.assign(ncols * nrows, std::vector<uint32_t>());
+    bin_of.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+        bin_of[i] = binOf(cx[i], cy[i]);
+        bins[bin_of[i]].push_back(i);
+    }
+}
+
+void NeighborLists::findNear(const ParticleStore &particles, uint32_t i,
+                             std::vector<uint32_t> &found) const
+{
+    int col = bin_of[i] % ncols, row = bin_of[i] / ncols;
+
+    found.clear();
+    for (int r = std::max(row - 1, 0); r <= std::min(row + 1, nrows - 1); r++) {
+        for (int c = std::max(col - 1, 0); c <= std::min(col + 1, ncols - 1); c++) {
+            for (uint32_t j : bins[r * ncols + c]) {
+                if (j != i && near(particles, i, j))
+                    found.push_back(j);
+            }
+        }
+    }
+
+    std::sort(found.begin(), found.end());
+}
+
+void NeighborLists::build(const ParticleStore &particles, double time)
+{
+    uint32_t n = particles.size();
+
+    cx.resize(n);
+    cy.resize(n);
+    lists.assign(n, std::vector<uint32_t>());
+    for (uint32_t i = 0; i < n; i++) {
+        cx[i] = particles.getX(i, time);
+        cy[i] = particles.getY(i, time);
+    }
+
+    bin(particles);
+    for (uint32_t i = 0; i < n; i++)
+        findNear(particles, i, lists[i]);
+}
+
+void NeighborLists::rebuild(const ParticleStore &particles, uint32_t i,
+                            double time)
+{
+    for (uint32_t j : lists[i]) {
+        std::vector<uint32_t> &list = lists[j];
+
+        list.erase(std::lower_bound(list.begin(), list.end(), i));
+    }
+
+    std::vector<uint32_t> &members = bins[bin_of[i]];
+
+    *std::find(members.begin(), members.end(), i) = members.back();
+    members.pop_back();
+
+    cx[i] = particles.getX(i, time);
+    cy[i] = particles.getY(i, time);
+    bin_of[i] = binOf(cx[i], cy[i]);
+    bins[bin_of[i]].push_back(i);
+
+    findNear(particles, i, lists[i]);
+    for (uint32_t j : lists[i]) {
+        std::vector<uint32_t> &list = lists[j];
+
+        list.insert(std::lower_bound(list.begin(), list.end(), i), i);
+    }
+}
+
+// The particle moves by a straight line from its position at t, so
+// it's the time the distance from the center grows to half the skin:
+// |d + v * dt| = skin / 2, where d is the offset from the center at t.
+// The position at t may be long before the list was built (the center
+// is where the particle is now), so it's the later root which is of
+// interest, whatever the sign of dt.
+double NeighborLists::predictExpiry(const ParticleStore &particles,
+                                    uint32_t i) const
+{
+    double dx = particles.getX(i) - cx[i], dy = particles.getY(i) - cy[i];
+    double vx = particles.getVX(i), vy = particles.getVY(i);
+    double reach = skin / 2;
+    double a = vx * vx + vy * vy;
+    double b = dx * vx + dy * vy;
+    double c = dx * dx + dy * dy - reach * reach;
+    double d = b * b - a * c;
+
+    if (a == 0)
+        return -1.0;
+    // the line does not even get near the center (which is only
+    // possible due to the rounding errors), the list is stale
+    if (d < 0)
+        return particles.getTime(i);
+
+    return particles.getTime(i) + (-b + std::sqrt(d)) / a;
+}
@@ -0,0 +1,79 @@
+#ifndef _NEIGHBOR_LISTS_HPP_
+#define _NEIGHBOR_LISTS_HPP_
+
+#include <vector>
+#include <cstdint>
+#include "particle_store.hpp"
+
+/*
+ * Neighbor lists used as a broadphase for collision prediction when
+ * there's no grid.
+ *
+ * Every particle has a center: the place it was at when its list was
+ * built. The list holds the particles whose centers are closer than
+ * the sum of the radii plus the skin. As long as both particles stay
+ * within half of the skin from their centers, a particle which is not
+ * on the list can't touch them, so only the list has to be tested.
+ *
+ * The simulation asks when a particle is going to leave the circle of
+ * half the skin around its center (the list expires then) and builds
+ * a new list for it when that happens; the particle is put into (or
+ * taken out of) the lists of the others at the same time, the lists
+ * are always symmetric.
+ *
+ * The centers are kept in square bins at least as large as the reach
+ * of any pair, so a list is built from the 3x3 bins around the center
+ * instead of all the particles.
+ */
+class NeighborLists {
+private:
+    // saves and restores the state directly
+    friend class Checkpoint;
+
+    double skin;
+    std::vector<double> cx, cy;
+    // sorted by the index of the particle
+    std::vector<std::vector<uint32_t>> lists;
+
+    // the bins laid over the centers (in no particular order)
+    double bin_size, min_x, min_y;
+    int ncols, nrows;
+    std::vector<std::vector<uint32_t>> bins;
+    std::vector<uint32_t> bin_of;
+
+    bool near(const ParticleStore &particles, uint32_t i, uint32_t j) const;
+    int binOf(double x, double y) const;
+    // lays the bins over the centers and puts them there
+    void bin(const ParticleStore &particles);
+    // the particles whose centers are near the center of @i, sorted
+    void findNear(const ParticleStore &particles, uint32_t i,
+                  std::vector<uint32_t> &found) const;
+
+public:
+    explicit NeighborLists(double skin);
+    ~NeighborLists() {};
+
+    double getSkin() const {
+        return skin;
+    }
+
+    const std::vector<uint32_t> &get(uint32_t i) const {
+        return lists[i];
+    }
+
+    // builds the lists of all the particles around their positions
+    // at @time
+    void build(const ParticleStore &particles, double time);
+
+    // builds a new list for particle @i around its position at @time
+    void rebuild(const ParticleStore &particles, uint32_t i, double time);
+
+    // get the time at which the list of particle @i expires,
+    // -1 if the particle does not move.
+    double predictExpiry(const ParticleStore &particles, uint32_t i) const;
+
+    // bytes allocated by the lists
+    size_t memoryUsage() const;
+};
+
+#endif /* _NEIGHBOR_LISTS_HPP_ */
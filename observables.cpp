@@ -0,0 +1,125 @@
+#include <cmath>
+#include <algorithm>
+#include "observables.hpp"
+
+namespace {
+
+const size_t nbins = 64;
+
+// the histogram covers speeds up to that many root mean squares
+const double histogram_range = 4.0;
+
+}
+
+Observables::Observables()
+    : histogram(nbins, 0)
+{
+    nparticles = 0;
+    perimeter = 0;
+    kinetic = speed_sum = 0;
+    last = since = 0;
+    distance = impulse = 0;
+    ncollisions = 0;
+    bin_width = 1;
+}
+
+void Observables::reset(const ParticleStore &particles, double perimeter,
+                        double time)
+{
+    double square_sum = 0;
+
+    nparticles = particles.size();
+    this->perimeter = perimeter;
+    kinetic = speed_sum = 0;
+    last = time;
+
+    for (uint32_t i = 0; i < nparticles; i++) {
+        double vx = particles.getVX(i), vy = particles.getVY(i);
+
+        square_sum += vx * vx + vy * vy;
+    }
+
+    bin_width = histogram_range * std::sqrt(square_sum / nparticles) / nbins;
+    if (bin_width == 0)
+        bin_width = 1;
+
+    std::fill(histogram.begin(), histogram.end(), 0);
+    for (uint32_t i = 0; i < nparticles; i++)
+        add(particles, i);
+
+    restart();
+}
+
+void Observables::restart()
+{
+    since = last;
+    distance = impulse = 0;
+    ncollisions = 0;
+}
+
+size_t Observables::bin(double speed) const
+{
+    return std::min((size_t)(speed / bin_width), nbins - 1);
+}
+
+void Observables::remove(const ParticleStore &particles, uint32_t i)
+{
+    double vx = particles.getVX(i), vy = particles.getVY(i);
+    double v2 = vx * vx + vy * vy, speed = std::sqrt(v2);
+
+    kinetic -= 0.5 * particles.getMass(i) * v2;
+    speed_sum -= speed;
+    histogram[bin(speed)]--;
+}
+
+void Observables::add(const ParticleStore &particles, uint32_t i)
+{
+    double vx = particles.getVX(i), vy = particles.getVY(i);
+    double v2 = vx * vx + vy * vy, speed = std::sqrt(v2);
+
+    kinetic += 0.5 * particles.getMass(i) * v2;
+    speed_sum += speed;
+    histogram[bin(speed)]++;
+}
+
+void Observables::wallHit(const ParticleStore &particles, uint32_t i,
+                          WallType wtype)
+{
+    double v = (wtype == WallType::Vertical) ?
+        particles.getVX(i) : particles.getVY(i);
+
+    impulse += 2 * particles.getMass(i) * std::fabs(v);
+}
+
+double Observables::getTemperature() const
+{
+    return nparticles ? kinetic / nparticles : 0;
+}
+
+double Observables::getMeanSpeed() const
+{
+    return nparticles ? speed_sum / nparticles : 0;
+}
+
+double Observables::getPressure() const
+{
+    double window = getWindow();
+
+    return (window > 0) ? impulse / (perimeter * window) : 0;
+}
+
+double Observables::getCollisionFrequency() const
+{
+    double window = getWindow();
+
+    // every collision counts for both particles
+    return (window > 0) ? 2.0 * ncollisions / (nparticles * window) : 0;
+}
+
+double Observables::getMeanFreePath() const
+{
+    if (ncollisions == 0)
+        return 0;
+
+    return distance / (2.0 * ncollisions);
+}
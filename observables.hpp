@@ -0,0 +1,104 @@
+#ifndef _OBSERVABLES_HPP_
+#define _OBSERVABLES_HPP_
+
+#include <vector>
+#include <cstdint>
+#include "particle_store.hpp"
+
+/*
+ * Thermodynamic quantities of the gas, kept up to date by the
+ * simulation as the events are processed. Every event changes the
+ * speeds of at most two particles, so only their contributions are
+ * replaced and nothing is ever recomputed over all the particles.
+ *
+ * Units are the ones of the simulation: pixels, units of simulation
+ * time and the masses of particles; the Boltzmann constant is 1.
+ *
+ * Kinetic energy, temperature and the speed histogram describe the
+ * current state. Pressure, collision frequency and mean free path are
+ * averages over a window of time, which starts when the simulation
+ * starts and again on every restart().
+ */
+class Observables {
+private:
+    friend class Simulation;
+
+    uint32_t nparticles;
+    double perimeter;
+
+    double kinetic; // sum of m * v^2 / 2
+    double speed_sum;
+    double last; // time of the last update
+
+    // accumulated over the window
+    double since;
+    double distance; // travelled by all the particles
+    double impulse; // passed to the walls
+    uint64_t ncollisions;
+
+    double bin_width;
+    std::vector<uint64_t> histogram;
+
+    size_t bin(double speed) const;
+
+    // @perimeter is the total length of the walls
+    void reset(const ParticleStore &particles, double perimeter, double time);
+
+    // the speed of particle @i is about to change (remove)
+    // or has just changed (add)
+    void remove(const ParticleStore &particles, uint32_t i);
+    void add(const ParticleStore &particles, uint32_t i);
+
+    void advance(double time) {
+        distance += speed_sum * (time - last);
+        last = time;
+    }
+
+    // particle @i is about to bounce off the wall
+    void wallHit(const ParticleStore &particles, uint32_t i, WallType wtype);
+
+    void collision() {
+        ncollisions++;
+    }
+
+public:
+    Observables();
+
+    // starts a new window for the averages
+    void restart();
+
+    double getKineticEnergy() const {
+        return kinetic;
+    }
+
+    // 2D gas: kT per particle
+    double getTemperature() const;
+
+    double getMeanSpeed() const;
+
+    // force per unit of length of the walls
+    double getPressure() const;
+
+    // collisions per particle per unit of time
+    double getCollisionFrequency() const;
+
+    // distance a particle travels between two collisions
+    double getMeanFreePath() const;
+
+    // the time the averages are taken over
+    double getWindow() const {
+        return last - since;
+    }
+
+    // number of particles by speed, the last bin also counts all
+    // the particles faster than the histogram covers
+    const std::vector<uint64_t> &getSpeedHistogram() const {
+        return histogram;
+    }
+
+    double getBinWidth() const {
+        return bin_width;
+    }
+};
+
+#endif /* _OBSERVABLES_HPP_ */
@@ -0,0 +1,584 @@
+#include <algorithm>
+
+#include "parallel_engine.hpp"
+
+ParallelEngine::ParallelEngine(Simulation &simulation, unsigned nregions)
+    : simulation(simulation), particles(simulation.particles),
+      pool(countRegions(simulation, nregions))
+{
+    int ncols = simulation.grid->getColumns();
+    unsigned n = pool.size();
+
+    regions.resize(n);
+    queue_of_column.resize(ncols);
+
+    // region r has queues 2r (the inner particles) and 2r + 1 (its
+    // side of the band), only borders between regions have the band
+    for (unsigned r = 0; r < n; r++) {
+        int first = r * ncols / n, last = (r + 1) * ncols / n;
+
+        regions[r].inner = 2 * r;
+        regions[r].band = 2 * r + 1;
+        regions[r].speculative = true;
+
+        for (int col = first; col < last; col++) {
+            bool band = (r > 0 && col == first) ||
+                (r < n - 1 && col == last - 1);
+
+            queue_of_column[col] = band ? regions[r].band : regions[r].inner;
+        }
+    }
+
+    serial.speculative = false;
+    stop_time = std::numeric_limits<double>::infinity();
+    nphases = 0;
+    nserial = 0;
+    nundone = 0;
+}
+
+unsigned ParallelEngine::countRegions(Simulation &simulation,
+                                      unsigned nregions)
+{
+    if (!simulation.use_grid)
+        throw SimulationError("The parallel engine needs the grid");
+    if (!simulation.initialized)
+        simulation.initializeEvents();
+    // a big particle would reach over the band
+    if (simulation.grid->getLevels() > 1)
+        throw SimulationError("The parallel engine needs a grid of "
+                              "a single level");
+
+    // at least an inner column between the band columns
+    unsigned ncols = simulation.grid->getColumns();
+    return std::max(std::min(nregions, ncols / 3), 1u);
+}
+
+uint32_t ParallelEngine::queueOf(int cell) const
+{
+    return queue_of_column[simulation.grid->getColumn(cell)];
+}
+
+// moves the pending events of the simulation to the queues of the regions
+void ParallelEngine::take()
+{
+    uint32_t n = particles.size();
+
+    events.reset(n, 2 * regions.size());
+    for (uint32_t i = 0; i < n; i++) {
+        const Event *ev = simulation.events.get(i);
+
+        events.setOwner(i, queueOf(simulation.grid->getCell(i)));
+        if (ev != nullptr)
+            events.put(i, *ev);
+    }
+
+    events.heapify();
+}
+
+void ParallelEngine::giveBack()
+{
+    EventQueue &queue = simulation.events;
+    uint32_t n = particles.size();
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (events.get(i) == nullptr)
+            queue.remove(i);
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (events.get(i) != nullptr)
+            queue.put(i, *events.get(i));
+    }
+
+    queue.heapify();
+
+    // nobody has been watching the observables meanwhile
+    simulation.resetObservables();
+}
+
+ParallelEngine::Key ParallelEngine::nextKey(uint32_t &queue) const
+{
+    Key next = infinity();
+
+    for (uint32_t q = 0; q < 2 * regions.size(); q++) {
+        if (events.empty(q))
+            continue;
+
+        Key key = {events.top(q).time, events.topSlot(q)};
+        if (key < next) {
+            next = key;
+            queue = q;
+        }
+    }
+
+    return next;
+}
+
+// an event of an inner particle that touches the band: it has to be
+// played between the phases
+bool ParallelEngine::crossesBand(const Region &region, const Event &ev) const
+{
+    switch (ev.type) {
+    case EventType::ParticleCollision:
+        return (events.getOwner(ev.pb) != region.inner);
+    case EventType::CellCrossing:
+        return (queueOf(ev.pb) != region.inner);
+    default:
+        break;
+    }
+
+    return false;
+}
+
+void ParallelEngine::runUntil(double time)
+{
+    if (time < simulation.now)
+        throw SimulationError("Simulation can not go back in time");
+
+    play(Key{time, std::numeric_limits<uint32_t>::max()},
+         std::numeric_limits<uint64_t>::max(), true);
+}
+
+void ParallelEngine::advance(double time)
+{
+    if (time < simulation.now)
+        throw SimulationError("Simulation can not go back in time");
+
+    // the refresh slot comes after all the particles
+    play(Key{time, (uint32_t)particles.size()},
+         std::numeric_limits<uint64_t>::max(), false);
+    simulation.now = time;
+    simulation.syncParticles();
+}
+
+uint64_t ParallelEngine::run(uint64_t n)
+{
+    uint64_t done = play(infinity(), n, false);
+
+    simulation.syncParticles();
+    return done;
+}
+
+// Plays the events before @limit, but no more than @budget of them.
+// Stale events coming out of the queue after the last one are thrown
+// away if @purge is set, as Simulation::nextEventTime does.
+uint64_t ParallelEngine::play(Key limit, uint64_t budget, bool purge)
+{
+    uint64_t done = 0;
+    uint32_t queue = 0;
+
+    take();
+
+    while (done < budget) {
+        Key next = nextKey(queue);
+
+        if (!(next < limit))
+            break;
+
+        // the earliest event is played in parallel with the others
+        // unless it's on the band
+        const Event &ev = events.top(queue);
+        if (queue == regions[queue / 2].inner &&
+            (simulation.isStale(ev) || !crossesBand(regions[queue / 2], ev))) {
+            done += runPhase(limit, budget - done);
+            continue;
+        }
+
+        if (playNext(serial, queue)) {
+            simulation.now = next.time;
+            simulation.nevents++;
+            nserial++;
+            done++;
+        }
+        else {
+            simulation.nstale++;
+        }
+    }
+
+    while (purge && nextKey(queue) < infinity() &&
+           simulation.isStale(events.top(queue))) {
+        playNext(serial, queue);
+        simulation.nstale++;
+    }
+
+    giveBack();
+    return done;
+}
+
+uint64_t ParallelEngine::runPhase(Key limit, uint64_t budget)
+{
+    Key bound = limit;
+
+    for (const Region &region : regions) {
+        if (!events.empty(region.band))
+            bound = std::min(bound, Key{events.top(region.band).time,
+                                        events.topSlot(region.band)});
+    }
+
+    nphases++;
+    stop_time = std::numeric_limits<double>::infinity();
+    pool.run(regions.size(), [&](size_t task, unsigned) {
+        runRegion(regions[task], bound, budget);
+    });
+
+    // everything before the earliest stop is exactly what the
+    // simulation would have played
+    Key cut = infinity();
+    for (const Region &region : regions)
+        cut = std::min(cut, region.stop);
+    for (Region &region : regions)
+        rollback(region, cut);
+
+    // the regions could have played more than the budget
+    // between them, keep the earliest ones
+    std::vector<Key> keys;
+    for (const Region &region : regions) {
+        for (const Played &played : region.played) {
+            if (!played.stale)
+                keys.push_back(played.key);
+        }
+    }
+
+    if (keys.size() > budget) {
+        std::nth_element(keys.begin(), keys.begin() + (budget - 1), keys.end());
+        cut = keys[budget - 1];
+
+        // the stale events of the same slot played right after the
+        // last event kept have to go too
+        for (Region &region : regions) {
+            size_t last = region.played.size();
+
+            while (last > 0 && cut < region.played[last - 1].key)
+                last--;
+            while (last > 0 && region.played[last - 1].stale &&
+                   !(region.played[last - 1].key < cut))
+                last--;
+            undo(region, last);
+        }
+    }
+
+    uint64_t done = 0;
+
+    for (Region &region : regions) {
+        for (const Played &played : region.played) {
+            if (played.stale) {
+                simulation.nstale++;
+                continue;
+            }
+
+            simulation.now = std::max(simulation.now, played.key.time);
+            simulation.nevents++;
+            done++;
+        }
+
+        region.played.clear();
+        region.saved_particles.clear();
+        region.saved_slots.clear();
+        region.saved_moves.clear();
+    }
+
+    return done;
+}
+
+// Plays the events of the inner particles of the region before @bound
+// (and before its own band events). The region stops at the first event
+// touching the band; the key of the first event it did not play is left
+// in region.stop.
+void ParallelEngine::runRegion(Region &region, Key bound, uint64_t budget)
+{
+    uint64_t count = 0;
+
+    while (true) {
+        Key stop = bound;
+
+        // the region may have predicted an earlier band event itself
+        if (!events.empty(region.band)) {
+            stop = std::min(stop, Key{events.top(region.band).time,
+                                      events.topSlot(region.band)});
+        }
+
+        if (events.empty(region.inner)) {
+            region.stop = stop;
+            break;
+        }
+
+        const Event &ev = events.top(region.inner);
+        Key next = {ev.time, events.topSlot(region.inner)};
+
+        if (!(next < stop)) {
+            region.stop = stop;
+            break;
+        }
+
+        // somebody has stopped already, whatever is played
+        // past that time is going to be undone
+        if (next.time > stop_time.load(std::memory_order_relaxed) ||
+            count == budget) {
+            region.stop = next;
+            return;
+        }
+
+        if (!simulation.isStale(ev) && crossesBand(region, ev)) {
+            region.stop = next;
+            break;
+        }
+
+        if (playNext(region, region.inner))
+            count++;
+    }
+
+    if (region.stop < bound)
+        publishStop(region.stop.time);
+}
+
+void ParallelEngine::publishStop(double time)
+{
+    double current = stop_time.load();
+
+    while (time < current && !stop_time.compare_exchange_weak(current, time))
+        ;
+}
+
+// Undoes all the events played by the region after @cut. The region
+// may have played a stale event of the very slot it stopped at, such
+// an event comes before the one replacing it.
+void ParallelEngine::rollback(Region &region, Key cut)
+{
+    size_t first = region.played.size();
+
+    while (first > 0 && cut < region.played[first - 1].key)
+        first--;
+    undo(region, first);
+}
+
+// undoes the events played by the region starting from @first
+void ParallelEngine::undo(Region &region, size_t first)
+{
+    if (first == region.played.size())
+        return;
+
+    const Played &from = region.played[first];
+    Grid &grid = *simulation.grid;
+
+    // Moves are undone in the reverse order, so the particle is the
+    // last one in its cell by then. It goes back to the place it had
+    // in the old cell, so the cells list their particles in the same
+    // order as if nothing happened.
+    for (size_t k = region.saved_moves.size(); k-- > from.moves; ) {
+        const SavedMove &saved = region.saved_moves[k];
+        std::vector<uint32_t> &to = grid.cells[grid.cell_of[saved.i]];
+        std::vector<uint32_t> &back = grid.cells[saved.from];
+
+        to.pop_back();
+        if (saved.index == back.size()) {
+            back.push_back(saved.i);
+        }
+        else {
+            back.push_back(back[saved.index]);
+            back[saved.index] = saved.i;
+        }
+        grid.cell_of[saved.i] = saved.from;
+    }
+
+    for (size_t k = region.saved_slots.size(); k-- > from.slots; ) {
+        const SavedSlot &saved = region.saved_slots[k];
+
+        if (saved.pending)
+            events.update(saved.slot, saved.ev);
+        else
+            events.remove(saved.slot);
+    }
+
+    for (size_t k = region.saved_particles.size(); k-- > from.particles; ) {
+        const SavedParticle &saved = region.saved_particles[k];
+
+        particles.x[saved.i] = saved.x;
+        particles.y[saved.i] = saved.y;
+        particles.t[saved.i] = saved.t;
+        particles.vx[saved.i] = saved.vx;
+        particles.vy[saved.i] = saved.vy;
+        particles.rev[saved.i] = saved.rev;
+    }
+
+    for (size_t k = first; k < region.played.size(); k++) {
+        if (!region.played[k].stale)
+            nundone++;
+    }
+
+    region.saved_moves.resize(from.moves);
+    region.saved_slots.resize(from.slots);
+    region.saved_particles.resize(from.particles);
+    region.played.resize(first);
+}
+
+// Plays the earliest event of the queue the way Simulation::processEvent
+// does; returns false if the event was stale.
+bool ParallelEngine::playNext(Region &region, uint32_t queue)
+{
+    uint32_t slot = events.topSlot(queue);
+    Event ev = events.top(queue);
+    bool stale = simulation.isStale(ev);
+
+    if (region.speculative) {
+        region.played.push_back(Played{Key{ev.time, slot}, stale,
+                                       region.saved_particles.size(),
+                                       region.saved_slots.size(),
+                                       region.saved_moves.size()});
+    }
+
+    if (stale) {
+        predictCollisions(region, slot, ev.time);
+        return false;
+    }
+
+    erase(region, slot);
+
+    switch (ev.type) {
+    case EventType::WallCollision:
+        save(region, ev.pa);
+        particles.advance(ev.pa, ev.time);
+        particles.bounceWall(ev.pa, ev.wtype);
+        predictCollisions(region, ev.pa, ev.time);
+        break;
+
+    case EventType::CellCrossing:
+        move(region, ev.pa, ev.pb);
+        predictCollisions(region, ev.pa, ev.time);
+        break;
+
+    case EventType::ParticleCollision:
+        save(region, ev.pa);
+        save(region, ev.pb);
+        particles.advance(ev.pa, ev.time);
+        particles.advance(ev.pb, ev.time);
+        particles.bounceParticle(ev.pa, ev.pb);
+        predictCollisions(region, ev.pa, ev.time);
+        predictCollisions(region, ev.pb, ev.time);
+        break;
+
+    case EventType::Refresh:
+    case EventType::ListExpiry: // there are no lists with the grid
+    case EventType::IntervalExpiry: // nor the sweep index
+        break;
+    }
+
+    return true;
+}
+
+// the same as Simulation::predictCollisions with the grid
+void ParallelEngine::predictCollisions(Region &region, uint32_t i,
+                                       double from)
+{
+    const Grid &grid = *simulation.grid;
+    uint32_t rev = particles.getRevision(i);
+    double time;
+    Event next;
+    bool found = false;
+
+    auto offer = [&](const Event &ev) {
+        if (!found || ev.time < next.time) {
+            next = ev;
+            found = true;
+        }
+    };
+
+    auto predict = [&](uint32_t j, double t) {
+        if (t < 0)
+            return;
+
+        double time = std::max(t, from);
+        offer(Event::particleCollision(time, i, rev,
+                                       j, particles.getRevision(j)));
+
+        const Event *pending = events.get(j);
+        if (pending == nullptr || time < pending->time) {
+            write(region, j, Event::particleCollision(time, j,
+                                                      particles.getRevision(j),
+                                                      i, rev));
+        }
+    };
+
+    std::vector<uint32_t> &candidates = region.candidates;
+    std::vector<double> &times = region.times;
+
+    candidates.clear();
+    grid.neighbors(grid.getCell(i), candidates);
+    times.resize(candidates.size());
+    particles.collidesParticles(i, candidates.data(), candidates.size(),
+                                times.data());
+    for (size_t k = 0; k < candidates.size(); k++)
+        predict(candidates[k], times[k]);
+
+    int cell;
+    time = grid.predictCrossing(particles, i, cell);
+    if (time >= 0)
+        offer(Event::cellCrossing(std::max(time, from), i, rev, cell));
+
+    for (WallType wtype : {WallType::Vertical, WallType::Horisontal}) {
+        time = particles.collidesWall(i, wtype);
+        if (time >= 0)
+            offer(Event::wallCollision(std::max(time, from), i, rev, wtype));
+    }
+
+    if (found)
+        write(region, i, next);
+    else
+        erase(region, i);
+}
+
+void ParallelEngine::write(Region &region, uint32_t slot, const Event &ev)
+{
+    if (region.speculative) {
+        const Event *pending = events.get(slot);
+
+        region.saved_slots.push_back(SavedSlot{slot, pending != nullptr,
+                                               pending ? *pending : Event()});
+    }
+
+    events.update(slot, ev);
+}
+
+void ParallelEngine::erase(Region &region, uint32_t slot)
+{
+    if (region.speculative) {
+        const Event *pending = events.get(slot);
+
+        region.saved_slots.push_back(SavedSlot{slot, pending != nullptr,
+                                               pending ? *pending : Event()});
+    }
+
+    events.remove(slot);
+}
+
+void ParallelEngine::save(Region &region, uint32_t i)
+{
+    if (!region.speculative)
+        return;
+
+    region.saved_particles.push_back(SavedParticle{
+        i, particles.rev[i], particles.x[i], particles.y[i], particles.t[i],
+        particles.vx[i], particles.vy[i]});
+}
+
+// a particle crossing into the band (or out of it) goes to another queue
+void ParallelEngine::move(Region &region, uint32_t i, int cell)
+{
+    Grid &grid = *simulation.grid;
+
+    if (region.speculative) {
+        const std::vector<uint32_t> &members = grid.cells[grid.cell_of[i]];
+        size_t index = std::find(members.begin(), members.end(), i) -
+            members.begin();
+
+        region.saved_moves.push_back(SavedMove{i, grid.cell_of[i], index});
+    }
+
+    grid.move(i, cell);
+    events.setOwner(i, queueOf(cell));
+}
+
+void ParallelEngine::printStats(std::ostream &os) const
+{
+    os << "regions " << regions.size() << " phases " << nphases
+       << " serial " << nserial << " undone " << nundone << std::endl;
+}
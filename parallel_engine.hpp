@@ -0,0 +1,159 @@
+#ifndef _PARALLEL_ENGINE_HPP_
+#define _PARALLEL_ENGINE_HPP_
+
+#include <vector>
+#include <atomic>
+#include <limits>
+#include <ostream>
+#include "simulation.hpp"
+#include "event_queue.hpp"
+#include "thread_pool.hpp"
+
+/*
+ * Plays the events of a simulation on several threads.
+ *
+ * The box is split into vertical strips of grid columns (regions), every
+ * region has its own queues and is played by a thread of its own. The
+ * columns on both sides of a border between two regions make the band:
+ * the band events are played by one thread, in the order of time over
+ * the whole box, between the parallel phases. Within a phase every
+ * region plays the events of its inner particles up to the earliest band
+ * event; such an event moves only the particles of its own region and
+ * reads the band particles next to it, which stay where they are during
+ * the phase. It may still make the pending events of those band
+ * particles earlier: they sit in the band queue of the region (its own
+ * edge columns), which no other thread touches, so the regions don't
+ * depend on each other.
+ *
+ * Hard disks have no lookahead though: any event of a region may predict
+ * a new band event, or involve the band itself (a collision with a band
+ * particle, crossing into the band), which may be due before the time
+ * the other regions have got to. So the regions run speculatively: every
+ * change they make is logged, a region stops at the first such event and
+ * once all of them are done the phase ends at the earliest event any of
+ * them stopped at. The events played past it are undone and played again
+ * in the next phase.
+ *
+ * The particles, the grid and the counters of the simulation are worked
+ * on in place; only the pending events are moved to the engine for the
+ * time of a run. The events are played exactly as the simulation plays
+ * them alone, so the results are the same bit for bit. The engine does
+ * not keep the observables and does not write the event log.
+ */
+class ParallelEngine {
+private:
+    // the order events are played in: by time, ties by the slot
+    struct Key {
+        double time;
+        uint32_t slot;
+
+        bool operator<(const Key &k) const {
+            return (time < k.time) || (time == k.time && slot < k.slot);
+        }
+    };
+
+    // undo records, kept by the regions while they run speculatively
+    struct SavedParticle {
+        uint32_t i;
+        uint32_t rev;
+        Scalar x, y;
+        double t;
+        Scalar vx, vy;
+    };
+
+    struct SavedSlot {
+        uint32_t slot;
+        bool pending;
+        Event ev;
+    };
+
+    struct SavedMove {
+        uint32_t i;
+        int from; // the cell it left
+        size_t index; // and where it was in that cell
+    };
+
+    // an event played speculatively and the sizes of
+    // the undo logs before it was played
+    struct Played {
+        Key key;
+        bool stale;
+        size_t particles, slots, moves;
+    };
+
+    struct Region {
+        uint32_t inner, band; // queues
+        bool speculative;
+        Key stop; // the first event the region did not play
+
+        // scratch buffers for collision prediction
+        std::vector<uint32_t> candidates;
+        std::vector<double> times;
+
+        std::vector<Played> played;
+        std::vector<SavedParticle> saved_particles;
+        std::vector<SavedSlot> saved_slots;
+        std::vector<SavedMove> saved_moves;
+    };
+
+    Simulation &simulation;
+    ParticleStore &particles;
+    EventQueueSet events;
+    std::vector<uint32_t> queue_of_column;
+    std::vector<Region> regions;
+    Region serial; // plays the band
+    ThreadPool pool;
+
+    // the earliest time a region stopped at in the current phase,
+    // the others don't go far past it
+    std::atomic<double> stop_time;
+
+    uint64_t nphases;
+    uint64_t nserial; // events played between the phases
+    uint64_t nundone; // events played speculatively and undone
+
+    static unsigned countRegions(Simulation &simulation, unsigned nregions);
+    void take();
+    void giveBack();
+    uint32_t queueOf(int cell) const;
+    Key nextKey(uint32_t &queue) const;
+    bool crossesBand(const Region &region, const Event &ev) const;
+    uint64_t play(Key limit, uint64_t budget, bool purge);
+    bool playNext(Region &region, uint32_t queue);
+    uint64_t runPhase(Key limit, uint64_t budget);
+    void runRegion(Region &region, Key limit, uint64_t budget);
+    void publishStop(double time);
+    void rollback(Region &region, Key cut);
+    void undo(Region &region, size_t first);
+    void predictCollisions(Region &region, uint32_t i, double from);
+    void write(Region &region, uint32_t slot, const Event &ev);
+    void erase(Region &region, uint32_t slot);
+    void save(Region &region, uint32_t i);
+    void move(Region &region, uint32_t i, int cell);
+
+    static Key infinity() {
+        return Key{std::numeric_limits<double>::infinity(),
+                   std::numeric_limits<uint32_t>::max()};
+    }
+
+public:
+    // The simulation has to use the grid of a single level. Every region
+    // takes at least three columns of it, so there may be fewer regions
+    // than asked for.
+    ParallelEngine(Simulation &simulation, unsigned nregions);
+    ~ParallelEngine() {};
+
+    unsigned getRegionCount() const {
+        return regions.size();
+    }
+
+    // the same as Simulation::runUntil, advance and run do
+    void runUntil(double time);
+    void advance(double time);
+    uint64_t run(uint64_t n);
+
+    // one line of the engine's counters
+    void printStats(std::ostream &os) const;
+};
+
+#endif /* _PARALLEL_ENGINE_HPP_ */
@@ -2,9 +2,18 @@
 #define _PARTICLE_HPP_
 
 #include <cmath>
-
-enum class WallType {Vertical, Horisontal};
-
+#include <cstdint>
+#include <ostream>
+#include "scalar.hpp"
+
+enum class WallType : uint8_t {Vertical, Horisontal};
+
+/*
+ * Description of a single particle as it comes from the configuration:
+ * it translates relative coordinates to the absolute ones and is used
+ * to validate particles before they're added to the simulation. The
+ * simulation itself keeps the state of particles in a ParticleStore.
+ */
 class Particle {
 private:
     // coordinates in relative form
@@ -15,41 +24,38 @@ private:
     double vx, vy;
     int radius, mass;
 
-    // vertical and horisontal bounds
-    int vbound, hbound;
-
     // color
     int r, g, b;
 
-    // revision of the particle,
-    // it's incremented every time particle collides
-    // with either wall or another particle
-    int rev;
-
-    double predictWallCollision(double coord, double velocity, int bound) const;
-    double round(double num, int precision) const;
-
 public:
     Particle(double x, double y, double vx, double vy, double radius, int mass,
              double vbound, double hbound, int r, int g, int b);
     ~Particle() {};
 
-    int getRevision() const {
-        return rev;
+    double getX() const {
+        return x;
+    }
+
+    double getY() const {
+        return y;
     }
 
-    int getX() const {
-        return std::round(x);
+    double getVX() const {
+        return vx;
     }
 
-    int getY() const {
-        return std::round(y);
+    double getVY() const {
+        return vy;
     }
 
     int getRadius() const {
         return radius;
     }
 
+    int getMass() const {
+        return mass;
+    }
+
     int getR() const {
         return r;
     }
@@ -62,24 +68,16 @@ public:
         return b;
     }
 
+    // turns the velocity by @angle (radians), the speed stays the same
+    void rotateVelocity(double angle);
+
     // returns true if this particle overlaps with another one
     bool overlaps(const Particle &p) const;
 
-    // bounce this particle of a wall
-    void bounceWall(WallType wtype);
-
-    // bounce this particle of another particle
-    void bounceParticle(Particle &p);
-
-    // get the time after which this particle collides a wall
-    double collidesWall(WallType wtype) const;
-
-    // get the time after which this particle collides another one
-    double collidesParticle(const Particle &p) const;
+    // returns true if this particle overlaps with a disk
+    // of the given radius centered at (x, y)
+    bool overlaps(double x, double y, int radius) const;
 
-    // move this particle to a position it should be after
-    // expiration of dt time
-    void move(double dt);
     friend std::ostream& operator<<(std::ostream &os, const Particle &p);
 };
 
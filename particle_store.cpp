@@ -0,0 +1,737 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include "particle_store.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Raw pointers to the arrays the collision prediction reads.
+template <class T>
+struct Kinematics {
+    const T *x, *y;
+    const double *t;
+    const T *vx, *vy;
+};
+
+// Radii and masses of the particles read from the arrays...
+struct Varied {
+    const int32_t *radii, *masses;
+
+    int radius(uint32_t i) const {
+        return radii[i];
+    }
+
+    int mass(uint32_t i) const {
+        return masses[i];
+    }
+};
+
+// ...or the same for all of them. The kernels are instantiated for
+// both, with this one the sizes are loop invariant constants instead
+// of loads (and gathers in the vector kernels).
+struct Uniform {
+    int r, m;
+
+    int radius(uint32_t) const {
+        return r;
+    }
+
+    int mass(uint32_t) const {
+        return m;
+    }
+};
+
+// Particles addressed by a contiguous range of indices
+struct RangeIndex {
+    uint32_t first;
+
+    uint32_t operator[](size_t k) const {
+        return first + k;
+    }
+};
+
+// Particles addressed by a list of indices
+struct ListIndex {
+    const uint32_t *js;
+
+    uint32_t operator[](size_t k) const {
+        return js[k];
+    }
+};
+
+template <class T, class Shape>
+inline double collisionTime(const Kinematics<T> &k, const Shape &shape,
+                            uint32_t i, uint32_t j)
+{
+    typedef ScalarPolicy<T> Policy;
+
+    if (i == j)
+        return -1.0;
+
+    // Positions of the particles may be known at different moments,
+    // so bring the one updated earlier to the time of the other. This
+    // way the result depends on the state of the particles only, no
+    // matter when the prediction is made.
+    double time = std::max(k.t[i], k.t[j]);
+    T dti = Policy::fromDouble(time - k.t[i]);
+    T dtj = Policy::fromDouble(time - k.t[j]);
+    T distance = T(shape.radius(i) + shape.radius(j));
+    T dx = (k.x[j] + k.vx[j] * dtj) - (k.x[i] + k.vx[i] * dti);
+    T dy = (k.y[j] + k.vy[j] * dtj) - (k.y[i] + k.vy[i] * dti);
+    T dvx = k.vx[j] - k.vx[i], dvy = k.vy[j] - k.vy[i];
+    T drdr = dx * dx + dy * dy;
+    T dvdv = dvx * dvx + dvy * dvy;
+    T dvdr = dvx * dx + dvy * dy;
+    T d = dvdr * dvdr - dvdv * (drdr - distance * distance);
+
+    if (dvdr >= T(0) || d < T(0))
+        return -1.0;
+
+    double dt = Policy::toDouble(-(dvdr + Policy::sqrt(d)) / dvdv);
+    return (dt < 0) ? dt : time + dt;
+}
+
+// no vector kernel for this type, everything is done by the scalar tail
+template <class T, class Shape, class Index>
+size_t collisionTimes(const Kinematics<T> &, const Shape &, uint32_t, Index,
+                      size_t, double *)
+{
+    return 0;
+}
+
+/*
+ * The vector kernels below do exactly the same operations in the
+ * same order as collisionTime does, so they give bit-identical
+ * results (this requires the compiler not to fuse multiplications
+ * and additions, see -ffp-contract in the Makefile). Lanes where
+ * the particles do not collide are computed anyway and masked out
+ * at the end; the particle itself gets dvdr == 0 and is masked too.
+ */
+#if defined(__AVX2__)
+
+static const size_t lanes = 4;
+
+inline __m256d load(const double *a, RangeIndex idx, size_t k)
+{
+    return _mm256_loadu_pd(a + idx[k]);
+}
+
+inline __m256d load(const double *a, ListIndex idx, size_t k)
+{
+    __m128i vidx = _mm_loadu_si128((const __m128i *)(idx.js + k));
+    __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), a, vidx, all, 8);
+}
+
+inline __m256d loadInt(const int32_t *a, RangeIndex idx, size_t k)
+{
+    return _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(a + idx[k])));
+}
+
+inline __m256d loadInt(const int32_t *a, ListIndex idx, size_t k)
+{
+    __m128i vidx = _mm_loadu_si128((const __m128i *)(idx.js + k));
+    return _mm256_cvtepi32_pd(_mm_mask_i32gather_epi32(
+        _mm_setzero_si128(), (const int *)a, vidx, _mm_set1_epi32(-1), 4));
+}
+
+// the sums of the radius of particle i (@ri) and the radii of the others
+template <class Index>
+inline __m256d sumRadii(__m256d ri, const Varied &shape, Index idx, size_t k)
+{
+    return _mm256_add_pd(ri, loadInt(shape.radii, idx, k));
+}
+
+template <class Index>
+inline __m256d sumRadii(__m256d ri, const Uniform &, Index, size_t)
+{
+    return _mm256_add_pd(ri, ri);
+}
+
+template <class Shape, class Index>
+size_t collisionTimes(const Kinematics<double> &k, const Shape &shape, uint32_t i,
+                      Index idx, size_t n, double *times)
+{
+    __m256d ti = _mm256_set1_pd(k.t[i]);
+    __m256d xi = _mm256_set1_pd(k.x[i]), yi = _mm256_set1_pd(k.y[i]);
+    __m256d vxi = _mm256_set1_pd(k.vx[i]), vyi = _mm256_set1_pd(k.vy[i]);
+    __m256d ri = _mm256_set1_pd(shape.radius(i));
+    __m256d zero = _mm256_setzero_pd(), none = _mm256_set1_pd(-1.0);
+    __m256d sign = _mm256_set1_pd(-0.0);
+    size_t done = 0;
+
+    for (; done + lanes <= n; done += lanes) {
+        __m256d tj = load(k.t, idx, done);
+        __m256d vxj = load(k.vx, idx, done), vyj = load(k.vy, idx, done);
+        __m256d time = _mm256_max_pd(ti, tj);
+        __m256d dist = sumRadii(ri, shape, idx, done);
+        __m256d dx = _mm256_sub_pd(
+            _mm256_add_pd(load(k.x, idx, done),
+                          _mm256_mul_pd(vxj, _mm256_sub_pd(time, tj))),
+            _mm256_add_pd(xi, _mm256_mul_pd(vxi, _mm256_sub_pd(time, ti))));
+        __m256d dy = _mm256_sub_pd(
+            _mm256_add_pd(load(k.y, idx, done),
+                          _mm256_mul_pd(vyj, _mm256_sub_pd(time, tj))),
+            _mm256_add_pd(yi, _mm256_mul_pd(vyi, _mm256_sub_pd(time, ti))));
+        __m256d dvx = _mm256_sub_pd(vxj, vxi), dvy = _mm256_sub_pd(vyj, vyi);
+        __m256d drdr = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+        __m256d dvdv = _mm256_add_pd(_mm256_mul_pd(dvx, dvx), _mm256_mul_pd(dvy, dvy));
+        __m256d dvdr = _mm256_add_pd(_mm256_mul_pd(dvx, dx), _mm256_mul_pd(dvy, dy));
+        __m256d d = _mm256_sub_pd(_mm256_mul_pd(dvdr, dvdr),
+            _mm256_mul_pd(dvdv, _mm256_sub_pd(drdr, _mm256_mul_pd(dist, dist))));
+        __m256d dt = _mm256_div_pd(
+            _mm256_xor_pd(_mm256_add_pd(dvdr, _mm256_sqrt_pd(d)), sign), dvdv);
+        __m256d res = _mm256_blendv_pd(_mm256_add_pd(time, dt), dt,
+                                       _mm256_cmp_pd(dt, zero, _CMP_LT_OQ));
+        __m256d miss = _mm256_or_pd(_mm256_cmp_pd(dvdr, zero, _CMP_GE_OQ),
+                                    _mm256_cmp_pd(d, zero, _CMP_LT_OQ));
+
+        _mm256_storeu_pd(times + done, _mm256_blendv_pd(res, none, miss));
+    }
+
+    return done;
+}
+
+// Floats take twice as many lanes. Times stay doubles, so the elapsed
+// times are computed in two halves and converted, just like the scalar
+// code converts them.
+static const size_t float_lanes = 2 * lanes;
+
+inline __m256 load(const float *a, RangeIndex idx, size_t k)
+{
+    return _mm256_loadu_ps(a + idx[k]);
+}
+
+inline __m256 load(const float *a, ListIndex idx, size_t k)
+{
+    __m256i vidx = _mm256_loadu_si256((const __m256i *)(idx.js + k));
+    return _mm256_i32gather_ps(a, vidx, 4);
+}
+
+inline __m256 loadIntPs(const int32_t *a, RangeIndex idx, size_t k)
+{
+    return _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)(a + idx[k])));
+}
+
+inline __m256 loadIntPs(const int32_t *a, ListIndex idx, size_t k)
+{
+    __m256i vidx = _mm256_loadu_si256((const __m256i *)(idx.js + k));
+    return _mm256_cvtepi32_ps(_mm256_i32gather_epi32((const int *)a, vidx, 4));
+}
+
+template <class Index>
+inline __m256 sumRadii(__m256 ri, const Varied &shape, Index idx, size_t k)
+{
+    return _mm256_add_ps(ri, loadIntPs(shape.radii, idx, k));
+}
+
+template <class Index>
+inline __m256 sumRadii(__m256 ri, const Uniform &, Index, size_t)
+{
+    return _mm256_add_ps(ri, ri);
+}
+
+inline __m256 joinPs(__m256d lo, __m256d hi)
+{
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),
+                                _mm256_cvtpd_ps(hi), 1);
+}
+
+// time + dt, or dt if it's negative
+inline __m256d finish(__m256d time, __m128 dt)
+{
+    __m256d wide = _mm256_cvtps_pd(dt);
+    return _mm256_blendv_pd(_mm256_add_pd(time, wide), wide,
+                            _mm256_cmp_pd(wide, _mm256_setzero_pd(), _CMP_LT_OQ));
+}
+
+template <class Shape, class Index>
+size_t collisionTimes(const Kinematics<float> &k, const Shape &shape, uint32_t i,
+                      Index idx, size_t n, double *times)
+{
+    __m256d ti = _mm256_set1_pd(k.t[i]);
+    __m256 xi = _mm256_set1_ps(k.x[i]), yi = _mm256_set1_ps(k.y[i]);
+    __m256 vxi = _mm256_set1_ps(k.vx[i]), vyi = _mm256_set1_ps(k.vy[i]);
+    __m256 ri = _mm256_set1_ps(shape.radius(i));
+    __m256 zero = _mm256_setzero_ps(), none = _mm256_set1_ps(-1.0f);
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    size_t done = 0;
+
+    for (; done + float_lanes <= n; done += float_lanes) {
+        __m256d tj0 = load(k.t, idx, done), tj1 = load(k.t, idx, done + lanes);
+        __m256d time0 = _mm256_max_pd(ti, tj0), time1 = _mm256_max_pd(ti, tj1);
+        __m256 dti = joinPs(_mm256_sub_pd(time0, ti), _mm256_sub_pd(time1, ti));
+        __m256 dtj = joinPs(_mm256_sub_pd(time0, tj0), _mm256_sub_pd(time1, tj1));
+        __m256 vxj = load(k.vx, idx, done), vyj = load(k.vy, idx, done);
+        __m256 dist = sumRadii(ri, shape, idx, done);
+        __m256 dx = _mm256_sub_ps(
+            _mm256_add_ps(load(k.x, idx, done), _mm256_mul_ps(vxj, dtj)),
+            _mm256_add_ps(xi, _mm256_mul_ps(vxi, dti)));
+        __m256 dy = _mm256_sub_ps(
+            _mm256_add_ps(load(k.y, idx, done), _mm256_mul_ps(vyj, dtj)),
+            _mm256_add_ps(yi, _mm256_mul_ps(vyi, dti)));
+        __m256 dvx = _mm256_sub_ps(vxj, vxi), dvy = _mm256_sub_ps(vyj, vyi);
+        __m256 drdr = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        __m256 dvdv = _mm256_add_ps(_mm256_mul_ps(dvx, dvx), _mm256_mul_ps(dvy, dvy));
+        __m256 dvdr = _mm256_add_ps(_mm256_mul_ps(dvx, dx), _mm256_mul_ps(dvy, dy));
+        __m256 d = _mm256_sub_ps(_mm256_mul_ps(dvdr, dvdr),
+            _mm256_mul_ps(dvdv, _mm256_sub_ps(drdr, _mm256_mul_ps(dist, dist))));
+        __m256 dt = _mm256_div_ps(
+            _mm256_xor_ps(_mm256_add_ps(dvdr, _mm256_sqrt_ps(d)), sign), dvdv);
+        __m256 miss = _mm256_or_ps(_mm256_cmp_ps(dvdr, zero, _CMP_GE_OQ),
+                                   _mm256_cmp_ps(d, zero, _CMP_LT_OQ));
+
+        // -1 stays negative, so the misses can be set before the times
+        // are added
+        dt = _mm256_blendv_ps(dt, none, miss);
+        _mm256_storeu_pd(times + done, finish(time0, _mm256_castps256_ps128(dt)));
+        _mm256_storeu_pd(times + done + lanes,
+                         finish(time1, _mm256_extractf128_ps(dt, 1)));
+    }
+
+    return done;
+}
+
+#elif defined(__SSE2__)
+
+static const size_t lanes = 2;
+
+inline __m128d load(const double *a, RangeIndex idx, size_t k)
+{
+    return _mm_loadu_pd(a + idx[k]);
+}
+
+inline __m128d load(const double *a, ListIndex idx, size_t k)
+{
+    return _mm_set_pd(a[idx[k + 1]], a[idx[k]]);
+}
+
+template <class Index>
+inline __m128d loadInt(const int32_t *a, Index idx, size_t k)
+{
+    return _mm_set_pd(a[idx[k + 1]], a[idx[k]]);
+}
+
+// the sums of the radius of particle i (@ri) and the radii of the others
+template <class Index>
+inline __m128d sumRadii(__m128d ri, const Varied &shape, Index idx, size_t k)
+{
+    return _mm_add_pd(ri, loadInt(shape.radii, idx, k));
+}
+
+template <class Index>
+inline __m128d sumRadii(__m128d ri, const Uniform &, Index, size_t)
+{
+    return _mm_add_pd(ri, ri);
+}
+
+inline __m128d select(__m128d mask, __m128d a, __m128d b)
+{
+    return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+template <class Shape, class Index>
+size_t collisionTimes(const Kinematics<double> &k, const Shape &shape, uint32_t i,
+                      Index idx, size_t n, double *times)
+{
+    __m128d ti = _mm_set1_pd(k.t[i]);
+    __m128d xi = _mm_set1_pd(k.x[i]), yi = _mm_set1_pd(k.y[i]);
+    __m128d vxi = _mm_set1_pd(k.vx[i]), vyi = _mm_set1_pd(k.vy[i]);
+    __m128d ri = _mm_set1_pd(shape.radius(i));
+    __m128d zero = _mm_setzero_pd(), none = _mm_set1_pd(-1.0);
+    __m128d sign = _mm_set1_pd(-0.0);
+    size_t done = 0;
+
+    for (; done + lanes <= n; done += lanes) {
+        __m128d tj = load(k.t, idx, done);
+        __m128d vxj = load(k.vx, idx, done), vyj = load(k.vy, idx, done);
+        __m128d time = _mm_max_pd(ti, tj);
+        __m128d dist = sumRadii(ri, shape, idx, done);
+        __m128d dx = _mm_sub_pd(
+            _mm_add_pd(load(k.x, idx, done), _mm_mul_pd(vxj, _mm_sub_pd(time, tj))),
+            _mm_add_pd(xi, _mm_mul_pd(vxi, _mm_sub_pd(time, ti))));
+        __m128d dy = _mm_sub_pd(
+            _mm_add_pd(load(k.y, idx, done), _mm_mul_pd(vyj, _mm_sub_pd(time, tj))),
+            _mm_add_pd(yi, _mm_mul_pd(vyi, _mm_sub_pd(time, ti))));
+        __m128d dvx = _mm_sub_pd(vxj, vxi), dvy = _mm_sub_pd(vyj, vyi);
+        __m128d drdr = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        __m128d dvdv = _mm_add_pd(_mm_mul_pd(dvx, dvx), _mm_mul_pd(dvy, dvy));
+        __m128d dvdr = _mm_add_pd(_mm_mul_pd(dvx, dx), _mm_mul_pd(dvy, dy));
+        __m128d d = _mm_sub_pd(_mm_mul_pd(dvdr, dvdr),
+            _mm_mul_pd(dvdv, _mm_sub_pd(drdr, _mm_mul_pd(dist, dist))));
+        __m128d dt = _mm_div_pd(
+            _mm_xor_pd(_mm_add_pd(dvdr, _mm_sqrt_pd(d)), sign), dvdv);
+        __m128d res = select(_mm_cmplt_pd(dt, zero), dt, _mm_add_pd(time, dt));
+        __m128d miss = _mm_or_pd(_mm_cmpge_pd(dvdr, zero), _mm_cmplt_pd(d, zero));
+
+        _mm_storeu_pd(times + done, select(miss, none, res));
+    }
+
+    return done;
+}
+
+static const size_t float_lanes = 2 * lanes;
+
+inline __m128 load(const float *a, RangeIndex idx, size_t k)
+{
+    return _mm_loadu_ps(a + idx[k]);
+}
+
+inline __m128 load(const float *a, ListIndex idx, size_t k)
+{
+    return _mm_set_ps(a[idx[k + 3]], a[idx[k + 2]], a[idx[k + 1]], a[idx[k]]);
+}
+
+template <class Index>
+inline __m128 loadIntPs(const int32_t *a, Index idx, size_t k)
+{
+    return _mm_cvtepi32_ps(_mm_set_epi32(a[idx[k + 3]], a[idx[k + 2]],
+                                         a[idx[k + 1]], a[idx[k]]));
+}
+
+template <class Index>
+inline __m128 sumRadii(__m128 ri, const Varied &shape, Index idx, size_t k)
+{
+    return _mm_add_ps(ri, loadIntPs(shape.radii, idx, k));
+}
+
+template <class Index>
+inline __m128 sumRadii(__m128 ri, const Uniform &, Index, size_t)
+{
+    return _mm_add_ps(ri, ri);
+}
+
+inline __m128 joinPs(__m128d lo, __m128d hi)
+{
+    return _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi));
+}
+
+inline __m128 selectPs(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// time + dt, or dt if it's negative (the two lower lanes of @dt)
+inline __m128d finish(__m128d time, __m128 dt)
+{
+    __m128d wide = _mm_cvtps_pd(dt);
+    return select(_mm_cmplt_pd(wide, _mm_setzero_pd()), wide,
+                  _mm_add_pd(time, wide));
+}
+
+template <class Shape, class Index>
+size_t collisionTimes(const Kinematics<float> &k, const Shape &shape, uint32_t i,
+                      Index idx, size_t n, double *times)
+{
+    __m128d ti = _mm_set1_pd(k.t[i]);
+    __m128 xi = _mm_set1_ps(k.x[i]), yi = _mm_set1_ps(k.y[i]);
+    __m128 vxi = _mm_set1_ps(k.vx[i]), vyi = _mm_set1_ps(k.vy[i]);
+    __m128 ri = _mm_set1_ps(shape.radius(i));
+    __m128 zero = _mm_setzero_ps(), none = _mm_set1_ps(-1.0f);
+    __m128 sign = _mm_set1_ps(-0.0f);
+    size_t done = 0;
+
+    for (; done + float_lanes <= n; done += float_lanes) {
+        __m128d tj0 = load(k.t, idx, done), tj1 = load(k.t, idx, done + lanes);
+        __m128d time0 = _mm_max_pd(ti, tj0), time1 = _mm_max_pd(ti, tj1);
+        __m128 dti = joinPs(_mm_sub_pd(time0, ti), _mm_sub_pd(time1, ti));
+        __m128 dtj = joinPs(_mm_sub_pd(time0, tj0), _mm_sub_pd(time1, tj1));
+        __m128 vxj = load(k.vx, idx, done), vyj = load(k.vy, idx, done);
+        __m128 dist = sumRadii(ri, shape, idx, done);
+        __m128 dx = _mm_sub_ps(
+            _mm_add_ps(load(k.x, idx, done), _mm_mul_ps(vxj, dtj)),
+            _mm_add_ps(xi, _mm_mul_ps(vxi, dti)));
+        __m128 dy = _mm_sub_ps(
+            _mm_add_ps(load(k.y, idx, done), _mm_mul_ps(vyj, dtj)),
+            _mm_add_ps(yi, _mm_mul_ps(vyi, dti)));
+        __m128 dvx = _mm_sub_ps(vxj, vxi), dvy = _mm_sub_ps(vyj, vyi);
+        __m128 drdr = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        __m128 dvdv = _mm_add_ps(_mm_mul_ps(dvx, dvx), _mm_mul_ps(dvy, dvy));
+        __m128 dvdr = _mm_add_ps(_mm_mul_ps(dvx, dx), _mm_mul_ps(dvy, dy));
+        __m128 d = _mm_sub_ps(_mm_mul_ps(dvdr, dvdr),
+            _mm_mul_ps(dvdv, _mm_sub_ps(drdr, _mm_mul_ps(dist, dist))));
+        __m128 dt = _mm_div_ps(
+            _mm_xor_ps(_mm_add_ps(dvdr, _mm_sqrt_ps(d)), sign), dvdv);
+        __m128 miss = _mm_or_ps(_mm_cmpge_ps(dvdr, zero), _mm_cmplt_ps(d, zero));
+
+        dt = selectPs(miss, none, dt);
+        _mm_storeu_pd(times + done, finish(time0, dt));
+        _mm_storeu_pd(times + done + lanes, finish(time1, _mm_movehl_ps(dt, dt)));
+    }
+
+    return done;
+}
+
+#endif
+
+template <class T, class Shape, class Index>
+void batchCollisionTimes(const Kinematics<T> &k, const Shape &shape,
+                         uint32_t i, Index idx, size_t n, double *times)
+{
+    size_t done = collisionTimes(k, shape, i, idx, n, times);
+
+    for (; done < n; done++)
+        times[done] = collisionTime(k, shape, i, idx[done]);
+}
+
+}
+
+template <class T>
+BasicParticleStore<T>::BasicParticleStore(int vbound, int hbound)
+{
+    this->vbound = vbound;
+    this->hbound = hbound;
+    uniform = true;
+}
+
+template <class T>
+void BasicParticleStore<T>::reserve(size_t n)
+{
+    for (std::vector<T> *v : {&x, &y, &vx, &vy})
+        v->reserve(n);
+    t.reserve(n);
+    radius.reserve(n);
+    mass.reserve(n);
+    rev.reserve(n);
+    color.reserve(n);
+}
+
+template <class T>
+size_t BasicParticleStore<T>::memoryUsage() const
+{
+    return (x.capacity() + y.capacity() + vx.capacity() + vy.capacity()) *
+        sizeof(T) + t.capacity() * sizeof(double) +
+        (radius.capacity() + mass.capacity()) * sizeof(int32_t) +
+        (rev.capacity() + color.capacity()) * sizeof(uint32_t);
+}
+
+template <class T>
+uint32_t BasicParticleStore<T>::add(const Particle &p)
+{
+    x.push_back(Policy::fromDouble(p.getX()));
+    y.push_back(Policy::fromDouble(p.getY()));
+    t.push_back(0.0);
+    vx.push_back(Policy::fromDouble(p.getVX()));
+    vy.push_back(Policy::fromDouble(p.getVY()));
+    radius.push_back(p.getRadius());
+    mass.push_back(p.getMass());
+    rev.push_back(0);
+    color.push_back((p.getR() << 16) | (p.getG() << 8) | p.getB());
+    uniform = uniform && radius.back() == radius[0] && mass.back() == mass[0];
+
+    return x.size() - 1;
+}
+
+template <class T>
+void BasicParticleStore<T>::checkUniform()
+{
+    uniform = true;
+    for (size_t i = 1; i < radius.size(); i++)
+        uniform = uniform && radius[i] == radius[0] && mass[i] == mass[0];
+}
+
+template <class T>
+int BasicParticleStore<T>::getMaxRadius() const
+{
+    int max_radius = 0;
+
+    for (int r : radius)
+        max_radius = std::max(max_radius, r);
+
+    return max_radius;
+}
+
+template <class T>
+int BasicParticleStore<T>::getMinRadius() const
+{
+    int min_radius = radius.empty() ? 0 : radius[0];
+
+    for (int r : radius)
+        min_radius = std::min(min_radius, r);
+
+    return min_radius;
+}
+
+template <class T>
+bool BasicParticleStore<T>::overlaps(const Particle &p, uint32_t i) const
+{
+    return p.overlaps(getX(i), getY(i), radius[i]);
+}
+
+template <class T>
+bool BasicParticleStore<T>::overlaps(uint32_t i, uint32_t j) const
+{
+    double dx = std::abs(getX(i) - getX(j)), dy = std::abs(getY(i) - getY(j));
+
+    // exactly the same rounding Particle::overlaps does
+    double rdist = ScalarPolicy<double>::round<4>(radius[i] + radius[j]);
+    double hipotenusa = ScalarPolicy<double>::round<4>(std::sqrt(dx * dx + dy * dy));
+
+    return (hipotenusa < rdist);
+}
+
+template <class T>
+void BasicParticleStore<T>::truncate(size_t n)
+{
+    for (std::vector<T> *v : {&x, &y, &vx, &vy})
+        v->resize(n);
+    t.resize(n);
+    radius.resize(n);
+    mass.resize(n);
+    rev.resize(n);
+    color.resize(n);
+    checkUniform();
+}
+
+template <class T>
+void BasicParticleStore<T>::bounceWall(uint32_t i, WallType wtype)
+{
+    if (wtype == WallType::Vertical)
+        vx[i] = -vx[i];
+    else
+        vy[i] = -vy[i];
+
+    rev[i]++;
+}
+
+template <class T>
+void BasicParticleStore<T>::bounceParticle(uint32_t i, uint32_t j)
+{
+    if (uniform)
+        bounce(i, j, Uniform{radius[0], mass[0]});
+    else
+        bounce(i, j, Varied{radius.data(), mass.data()});
+}
+
+template <class T>
+template <class Shape>
+void BasicParticleStore<T>::bounce(uint32_t i, uint32_t j, const Shape &shape)
+{
+    T dx = x[j] - x[i], dy = y[j] - y[i];
+    T dvx = vx[j] - vx[i], dvy = vy[j] - vy[i];
+    T dvdr = dvx * dx + dvy * dy;
+    int mi = shape.mass(i), mj = shape.mass(j);
+    int distance = shape.radius(i) + shape.radius(j);
+
+    // calculate the impulse
+    T J = (T(2 * mi * mj) * dvdr) / T(distance * (mi + mj));
+    T Jx = J * dx / T(distance);
+    T Jy = J * dy / T(distance);
+
+    /*
+     * And apply the Newton's second law to compute velocities
+     * after collision.
+     *
+     * Note:
+     * Limit the precision of calculation results rounding
+     * them to 8 digits after the point. This helps to avoid
+     * floating point error accumulating in less significant
+     * digits of mantissa. The policy knows the multiplier at
+     * compile time.
+     */
+
+    vx[i] = Policy::template round<8>(vx[i] + Jx / T(mi));
+    vy[i] = Policy::template round<8>(vy[i] + Jy / T(mi));
+    vx[j] = Policy::template round<8>(vx[j] - Jx / T(mj));
+    vy[j] = Policy::template round<8>(vy[j] - Jy / T(mj));
+
+    rev[i]++;
+    rev[j]++;
+}
+
+template <class T>
+double BasicParticleStore<T>::collidesWall(uint32_t i, WallType wtype) const
+{
+    double dt = -1.0;
+
+    switch (wtype) {
+    case WallType::Vertical:
+        dt = predictWallCollision(x[i], vx[i], radius[i], vbound);
+        break;
+    case WallType::Horisontal:
+        dt = predictWallCollision(y[i], vy[i], radius[i], hbound);
+        break;
+    }
+
+    return (dt < 0) ? dt : t[i] + dt;
+}
+
+template <class T>
+double BasicParticleStore<T>::collidesParticle(uint32_t i, uint32_t j) const
+{
+    Kinematics<T> k = {x.data(), y.data(), t.data(), vx.data(), vy.data()};
+
+    if (uniform)
+        return collisionTime(k, Uniform{radius[0], mass[0]}, i, j);
+    return collisionTime(k, Varied{radius.data(), mass.data()}, i, j);
+}
+
+template <class T>
+void BasicParticleStore<T>::collidesParticles(uint32_t i, const uint32_t *js,
+                                              size_t n, double *times) const
+{
+    Kinematics<T> k = {x.data(), y.data(), t.data(), vx.data(), vy.data()};
+
+    if (uniform)
+        batchCollisionTimes(k, Uniform{radius[0], mass[0]}, i, ListIndex{js},
+                            n, times);
+    else
+        batchCollisionTimes(k, Varied{radius.data(), mass.data()}, i,
+                            ListIndex{js}, n, times);
+}
+
+template <class T>
+void BasicParticleStore<T>::collidesParticleRange(uint32_t i, uint32_t first,
+                                                  uint32_t last,
+                                                  double *times) const
+{
+    Kinematics<T> k = {x.data(), y.data(), t.data(), vx.data(), vy.data()};
+
+    if (uniform)
+        batchCollisionTimes(k, Uniform{radius[0], mass[0]}, i,
+                            RangeIndex{first}, last - first, times);
+    else
+        batchCollisionTimes(k, Varied{radius.data(), mass.data()}, i,
+                            RangeIndex{first}, last - first, times);
+}
+
+template <class T>
+void BasicParticleStore<T>::advance(uint32_t i, double time)
+{
+    T dt = Policy::fromDouble(time - t[i]);
+
+    x[i] += vx[i] * dt;
+    y[i] += vy[i] * dt;
+    t[i] = time;
+}
+
+template <class T>
+double BasicParticleStore<T>::predictWallCollision(T coord, T velocity,
+                                                   int radius, int bound) const
+{
+    if (velocity > T(0))
+        return Policy::toDouble((T(bound - radius) - coord) / velocity);
+    else if (velocity < T(0))
+        return Policy::toDouble((T(radius) - coord) / velocity);
+    else
+        return -1.0;
+}
+
+template <class T>
+void BasicParticleStore<T>::describe(std::ostream &os, uint32_t i) const
+{
+    os << "#" << i << " (x: " << getX(i) << ", y: " << getY(i) << ", vx: "
+       << getVX(i) << ", vy: " << getVY(i) << ", mass: " << mass[i]
+       << ", radius: " << radius[i] << ", rev: " << rev[i] << ")";
+}
+
+// all of them are built, whichever the engine uses
+template class BasicParticleStore<double>;
+template class BasicParticleStore<float>;
+template class BasicParticleStore<Fixed>;
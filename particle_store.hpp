@@ -0,0 +1,175 @@
+#ifndef _PARTICLE_STORE_HPP_
+#define _PARTICLE_STORE_HPP_
+
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include "particle.hpp"
+#include "scalar.hpp"
+
+/*
+ * State of all the particles of the simulation.
+ *
+ * Every attribute lives in its own contiguous array indexed by the
+ * particle number (structure of arrays), so the prediction loops
+ * that go over many particles read only the attributes they need
+ * and can process several particles at once with SIMD instructions.
+ *
+ * Positions are not updated all together: x and y of a particle are
+ * its position at time t, and each particle is brought up to date
+ * only when it takes part in an event.
+ *
+ * Positions and velocities are kept in T, see scalar.hpp; the getters
+ * give doubles whatever it is. The engine uses the ParticleStore the
+ * build was configured for.
+ */
+template <class T>
+class BasicParticleStore {
+private:
+    // saves and restores the state directly
+    friend class Checkpoint;
+    // replays logged events
+    friend class EventReplay;
+    // undoes events processed speculatively
+    friend class ParallelEngine;
+
+    typedef ScalarPolicy<T> Policy;
+
+    // vertical and horisontal bounds
+    int vbound, hbound;
+
+    std::vector<T> x, y;
+    std::vector<double> t;
+    std::vector<T> vx, vy;
+    std::vector<int32_t> radius, mass;
+
+    // revision of the particle,
+    // it's incremented every time particle collides
+    // with either wall or another particle
+    std::vector<uint32_t> rev;
+
+    // color packed as 0xRRGGBB, it's only needed for drawing
+    std::vector<uint32_t> color;
+
+    // all the particles have the same radius and mass,
+    // the kernels specialized for that are used then
+    bool uniform;
+
+    double predictWallCollision(T coord, T velocity,
+                                int radius, int bound) const;
+
+    // finds out if the particles are uniform again,
+    // after the arrays were changed directly
+    void checkUniform();
+
+    // bounceParticle for particles of the given @shape
+    template <class Shape>
+    void bounce(uint32_t i, uint32_t j, const Shape &shape);
+
+public:
+    BasicParticleStore(int vbound, int hbound);
+    ~BasicParticleStore() {};
+
+    size_t size() const {
+        return x.size();
+    }
+
+    void reserve(size_t n);
+
+    // adds a particle, returns its index
+    uint32_t add(const Particle &p);
+
+    // the time the position of the particle was last updated at
+    double getTime(uint32_t i) const {
+        return t[i];
+    }
+
+    double getX(uint32_t i) const {
+        return Policy::toDouble(x[i]);
+    }
+
+    double getY(uint32_t i) const {
+        return Policy::toDouble(y[i]);
+    }
+
+    // position of the particle at the given time,
+    // computed the same way advance does
+    double getX(uint32_t i, double time) const {
+        return Policy::toDouble(x[i] + vx[i] * Policy::fromDouble(time - t[i]));
+    }
+
+    double getY(uint32_t i, double time) const {
+        return Policy::toDouble(y[i] + vy[i] * Policy::fromDouble(time - t[i]));
+    }
+
+    double getVX(uint32_t i) const {
+        return Policy::toDouble(vx[i]);
+    }
+
+    double getVY(uint32_t i) const {
+        return Policy::toDouble(vy[i]);
+    }
+
+    int getRadius(uint32_t i) const {
+        return radius[i];
+    }
+
+    int getMass(uint32_t i) const {
+        return mass[i];
+    }
+
+    uint32_t getRevision(uint32_t i) const {
+        return rev[i];
+    }
+
+    uint32_t getColor(uint32_t i) const {
+        return color[i];
+    }
+
+    int getMaxRadius() const;
+    int getMinRadius() const;
+
+    // bytes allocated for the particles
+    size_t memoryUsage() const;
+
+    // returns true if particle @p overlaps with particle @i
+    bool overlaps(const Particle &p, uint32_t i) const;
+
+    // the same for two particles of the store
+    bool overlaps(uint32_t i, uint32_t j) const;
+
+    // drops all the particles starting from @n
+    void truncate(size_t n);
+
+    // bounce particle @i of a wall
+    void bounceWall(uint32_t i, WallType wtype);
+
+    // bounce particles @i and @j of each other,
+    // both have to be advanced to the same time before.
+    void bounceParticle(uint32_t i, uint32_t j);
+
+    // get the time at which particle @i collides a wall
+    double collidesWall(uint32_t i, WallType wtype) const;
+
+    // get the time at which particle @i collides particle @j
+    double collidesParticle(uint32_t i, uint32_t j) const;
+
+    // Batch versions of collidesParticle: compute the times at which
+    // particle @i collides each of @n particles listed in @js or each
+    // of the particles [@first, @last). Results go to @times, -1 if
+    // the particles do not collide. The results are exactly the same
+    // as collidesParticle gives.
+    void collidesParticles(uint32_t i, const uint32_t *js, size_t n,
+                           double *times) const;
+    void collidesParticleRange(uint32_t i, uint32_t first, uint32_t last,
+                               double *times) const;
+
+    // move particle @i to a position it should be at the given time
+    void advance(uint32_t i, double time);
+
+    void describe(std::ostream &os, uint32_t i) const;
+};
+
+typedef BasicParticleStore<Scalar> ParticleStore;
+
+#endif /* _PARTICLE_STORE_HPP_ */
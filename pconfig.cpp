@@ -1,60 +1,500 @@
 #include <string>
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <thread>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "pconfig.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+const char magic[8] = {'P', 'A', 'R', 'T', 'C', 'O', 'N', 'F'};
+const uint32_t byte_order = 0x01020304;
+const uint32_t version = 1;
+
+struct BinaryHeader {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint64_t count;
+};
+
+// files smaller than that are not worth splitting between threads
+const size_t parallel_size = 4 << 20;
+
+const double powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Quick path for the usual numbers like 0.281079: when the digits fit
+// into the 53 bits of a double and the power of ten is exact too, the
+// single division (or multiplication) gives the correctly rounded
+// result, exactly what strtod does for the same text.
+bool quickDouble(const char *p, const char *end, double &val)
+{
+    bool negative = false;
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool seen_digit = false;
+
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        seen_digit = true;
+        if (mantissa == 0 && *p == '0')
+            continue;
+        if (++digits > 19)
+            return false;
+        mantissa = mantissa * 10 + (*p - '0');
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+            seen_digit = true;
+            exponent--;
+            if (mantissa == 0 && *p == '0')
+                continue;
+            if (++digits > 19)
+                return false;
+            mantissa = mantissa * 10 + (*p - '0');
+        }
+    }
+    if (!seen_digit || p != end)
+        return false; // exponents and the like are left to strtod
+
+    if (mantissa > (1ULL << 53) || exponent < -22)
+        return false;
+
+    val = (double)mantissa / powers_of_ten[-exponent];
+    if (negative)
+        val = -val;
+    return true;
+}
+
+template <class T>
+void checkRange(T val, int line, int col, const std::string &name,
+                T floor, T ceil)
+{
+    // NaN would pass both of the comparisons below
+    if (!std::isfinite(val))
+        throw PConfigError(line, col, name + " is not a number");
+    if (val < floor)
+        throw PConfigError(line, col, name + " can not be less than " +
+                           std::to_string(floor));
+    if (val > ceil)
+        throw PConfigError(line, col, name + " can not be greater than " +
+                           std::to_string(ceil));
+}
+
+class LineParser {
+private:
+    const char *p, *end;
+    int line, col;
+
+    // the next value of the line
+    void token(const std::string &name, const char *&first,
+               const char *&last) {
+        while (p < end && isSpace(*p))
+            p++;
+        if (p == end)
+            throw PConfigError(line, col, name + " was expected next, but " +
+                               "got nothing");
+        first = p;
+        while (p < end && !isSpace(*p))
+            p++;
+        last = p;
+    }
+
+    template <class T>
+    T check(T val, const std::string &name, T floor, T ceil) {
+        checkRange(val, line, col, name, floor, ceil);
+        col++;
+        return val;
+    }
+
+public:
+    LineParser(const char *first, const char *last, int line)
+        : p(first), end(last), line(line), col(0) {}
+
+    double readDouble(const std::string &name, double floor, double ceil) {
+        const char *first, *last;
+        double val;
+
+        token(name, first, last);
+        if (!quickDouble(first, last, val)) {
+            char buf[64];
+            char *parsed;
+            size_t len = last - first;
+
+            if (len >= sizeof(buf))
+                throw PConfigError(line, col, name + " is not a number");
+
+            memcpy(buf, first, len);
+            buf[len] = '\0';
+            val = strtod(buf, &parsed);
+            if (parsed != buf + len)
+                throw PConfigError(line, col, name + " is not a number");
+        }
+
+        return check(val, name, floor, ceil);
+    }
+
+    int readInt(const std::string &name, int floor, int ceil) {
+        const char *first, *last;
+        bool negative = false;
+        long long val = 0;
+
+        token(name, first, last);
+        if (*first == '-' || *first == '+')
+            negative = (*first++ == '-');
+        if (first == last || last - first > 18)
+            throw PConfigError(line, col, name + " is not an integer");
+        for (; first < last; first++) {
+            if (*first < '0' || *first > '9')
+                throw PConfigError(line, col, name + " is not an integer");
+            val = val * 10 + (*first - '0');
+        }
+        if (negative)
+            val = -val;
+
+        return check<long long>(val, name, floor, ceil);
+    }
+};
+
+void parseEntry(const char *first, const char *last, int line,
+                PConfigEntry &entry)
+{
+    LineParser lp(first, last, line);
+
+    entry.rx = lp.readDouble("X coordinate", 0.0, 1.0);
+    entry.ry = lp.readDouble("Y coordinate", 0.0, 1.0);
+    entry.vx = lp.readDouble("X velocity", -1.0, 1.0);
+    entry.vy = lp.readDouble("Y velocity", -1.0, 1.0);
+    entry.mass = lp.readInt("Mass", 1, 100);
+    entry.radius = lp.readDouble("Radius", 0.0, 1.0);
+    entry.r = lp.readInt("Red value", 0, 255);
+    entry.g = lp.readInt("Green value", 0, 255);
+    entry.b = lp.readInt("Blue value", 0, 255);
+}
+
+// the same checks for an entry of a binary config
+void checkEntry(const PConfigEntry &entry, int line)
+{
+    checkRange(entry.rx, line, 0, "X coordinate", 0.0, 1.0);
+    checkRange(entry.ry, line, 1, "Y coordinate", 0.0, 1.0);
+    checkRange(entry.vx, line, 2, "X velocity", -1.0, 1.0);
+    checkRange(entry.vy, line, 3, "Y velocity", -1.0, 1.0);
+    checkRange(entry.mass, line, 4, "Mass", 1, 100);
+    checkRange(entry.radius, line, 5, "Radius", 0.0, 1.0);
+    checkRange(entry.r, line, 6, "Red value", 0, 255);
+    checkRange(entry.g, line, 7, "Green value", 0, 255);
+    checkRange(entry.b, line, 8, "Blue value", 0, 255);
+}
+
+// Finds the next line holding an entry in [@p, @end). @p is moved past
+// the line, @line is incremented for every line passed. Returns false
+// if there are no more entries.
+bool nextLine(const char *&p, const char *end, int &line,
+              const char *&first, const char *&last)
+{
+    while (p < end) {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+
+        if (eol == nullptr)
+            eol = end;
+
+        first = p;
+        last = eol;
+        p = (eol < end) ? eol + 1 : end;
+        line++;
+
+        while (first < last && isSpace(*first))
+            first++;
+        if (first < last && *first != '#')
+            return true;
+    }
+
+    return false;
+}
+
+// parses all the lines of [@p, @end), returns the number of lines
+int parseLines(const char *p, const char *end, int line,
+               std::vector<PConfigEntry> &out)
+{
+    const char *first, *last;
+    int start = line;
+
+    while (nextLine(p, end, line, first, last)) {
+        out.emplace_back();
+        parseEntry(first, last, line, out.back());
+    }
+
+    return line - start;
+}
+
+std::string describeError(const std::string &path)
+{
+    return path + ": " + strerror(errno);
+}
+
+}
 
 PConfig::PConfig(const char *cfg_file)
 {
-    ifile.open(cfg_file, std::ifstream::in);
+    int fd = open(cfg_file, O_RDONLY);
+    struct stat st;
 
     // oh, how I hate this ridiculous error reporting
     // in C++ streams. Even more than I hate streams
     // themselves.
-    if (ifile.fail())
-        throw std::ios_base::failure(strerror(errno));
+    if (fd < 0)
+        throw std::ios_base::failure(describeError(cfg_file));
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::ios_base::failure(describeError(cfg_file));
+    }
 
+    data = nullptr;
+    size = st.st_size;
+    pos = 0;
     lineNum = 0;
+    binary = false;
+    nentries = 0;
+
+    if (size > 0) {
+        void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapped == MAP_FAILED) {
+            close(fd);
+            throw std::ios_base::failure(describeError(cfg_file));
+        }
+        data = static_cast<const char *>(mapped);
+    }
+    close(fd);
+
+    if (size < sizeof(magic) || memcmp(data, magic, sizeof(magic)) != 0)
+        return;
+
+    BinaryHeader header;
+
+    // the destructor won't run if the constructor
+    // throws, so the file is unmapped here
+    try {
+        binary = true;
+        if (size < sizeof(header))
+            throw PConfigError(0, 0, "Binary config is truncated");
+
+        memcpy(&header, data, sizeof(header));
+        if (header.byte_order != byte_order)
+            throw PConfigError(0, 0, "Binary config was written on a machine "
+                               "with different byte order");
+        if (header.version != version)
+            throw PConfigError(0, 0, "Binary config has unsupported version " +
+                               std::to_string(header.version));
+
+        nentries = header.count;
+        if ((size - sizeof(header)) / (5 * sizeof(double) +
+                                       4 * sizeof(int32_t)) < nentries) {
+            throw PConfigError(0, 0, "Binary config is truncated");
+        }
+    }
+    catch (...) {
+        munmap(const_cast<char *>(data), size);
+        throw;
+    }
 }
 
 PConfig::~PConfig()
 {
-    ifile.close();
+    if (data != nullptr)
+        munmap(const_cast<char *>(data), size);
 }
 
-std::unique_ptr<PConfigEntry> PConfig::nextEntry()
+// Values of a binary config are stored in columns: rx, ry, vx, vy
+// and radius as doubles, then mass, r, g and b as 32 bit integers.
+void PConfig::parseBinary(size_t first, size_t last, PConfigEntry *out) const
 {
-    std::string line;
+    const char *doubles = data + sizeof(BinaryHeader);
+    const char *ints = doubles + 5 * nentries * sizeof(double);
 
-    while (true) {
-        if (ifile.eof())
-            return nullptr;
+    for (size_t k = first; k < last; k++) {
+        PConfigEntry &entry = out[k - first];
+        double *dfields[] = {
+            &entry.rx, &entry.ry, &entry.vx, &entry.vy, &entry.radius,
+        };
+        int *ifields[] = {&entry.mass, &entry.r, &entry.g, &entry.b};
+
+        for (size_t f = 0; f < 5; f++) {
+            memcpy(dfields[f], doubles + (f * nentries + k) * sizeof(double),
+                   sizeof(double));
+        }
+        for (size_t f = 0; f < 4; f++) {
+            int32_t val;
+
+            memcpy(&val, ints + (f * nentries + k) * sizeof(int32_t),
+                   sizeof(val));
+            *ifields[f] = val;
+        }
+
+        checkEntry(entry, k + 1);
+    }
+}
 
-        std::getline(ifile, line);
-        lineNum++;
+std::unique_ptr<PConfigEntry> PConfig::nextEntry()
+{
+    PConfigEntry *entry;
 
-        if (line == "")
+    if (binary) {
+        if (pos >= nentries)
             return nullptr;
-        if (line[0] != '#')
-            break;
+
+        entry = new PConfigEntry();
+        parseBinary(pos, pos + 1, entry);
+        pos++;
+        return std::unique_ptr<PConfigEntry>(entry);
     }
 
-    std::istringstream ss(line);
-    PConfigEntry *entry = new PConfigEntry();
+    const char *p = data + pos, *end = data + size;
+    const char *first, *last;
 
-    colNum = 0;
-    entry->rx = readValue<double>(ss, "X coordinate", 0.0, 1.0);
-    entry->ry = readValue<double>(ss, "Y coordinate", 0.0, 1.0);
-    entry->vx = readValue<double>(ss, "X velocity", -1.0, 1.0);
-    entry->vy = readValue<double>(ss, "Y velocity", -1.0, 1.0);
-    entry->mass = readValue<int>(ss, "Mass", 1, 100);
-    entry->radius = readValue<double>(ss, "Radius", 0.0, 1.0);
-    entry->r = readValue<int>(ss, "Red value", 0, 255);
-    entry->g = readValue<int>(ss, "Green value", 0, 255);
-    entry->b = readValue<int>(ss, "Blue value", 0, 255);
+    if (!nextLine(p, end, lineNum, first, last)) {
+        pos = size;
+        return nullptr;
+    }
+
+    pos = p - data;
+    entry = new PConfigEntry();
+    parseEntry(first, last, lineNum, *entry);
 
     return std::unique_ptr<PConfigEntry>(entry);
 }
 
+std::vector<PConfigEntry> PConfig::readAll(unsigned nthreads)
+{
+    std::vector<PConfigEntry> entries;
+
+    if (binary) {
+        entries.resize(nentries - pos);
+        parseBinary(pos, nentries, entries.data());
+        pos = nentries;
+        return entries;
+    }
+
+    if (nthreads == 0)
+        nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    const char *p = data + pos, *end = data + size;
+
+    if (nthreads == 1 || size_t(end - p) < parallel_size) {
+        lineNum += parseLines(p, end, lineNum, entries);
+        pos = size;
+        return entries;
+    }
+
+    // Split the text into chunks of whole lines; every chunk is parsed
+    // by a thread of its own counting lines from 0, the line numbers
+    // are fixed once all the chunks are done.
+    size_t nchunks = nthreads * 4;
+    std::vector<const char *> bounds = {p};
+    std::vector<std::vector<PConfigEntry>> parsed(nchunks);
+    std::vector<int> nlines(nchunks, 0);
+    std::vector<std::unique_ptr<PConfigError>> errors(nchunks);
+
+    for (size_t k = 1; k < nchunks; k++) {
+        const char *b = std::max(p + (end - p) * k / nchunks, bounds.back());
+        const char *eol = static_cast<const char *>(memchr(b, '\n', end - b));
+
+        bounds.push_back(eol ? eol + 1 : end);
+    }
+    bounds.push_back(end);
+
+    ThreadPool pool(nthreads);
+    pool.run(nchunks, [&](size_t k, unsigned) {
+        try {
+            nlines[k] = parseLines(bounds[k], bounds[k + 1], 0, parsed[k]);
+        }
+        catch (PConfigError &e) {
+            errors[k].reset(new PConfigError(e));
+        }
+    });
+
+    size_t total = 0;
+    int line = lineNum;
+
+    for (size_t k = 0; k < nchunks; k++) {
+        if (errors[k]) {
+            throw PConfigError(line + errors[k]->getLine(),
+                               errors[k]->getColumn(), errors[k]->what());
+        }
+        line += nlines[k];
+        total += parsed[k].size();
+    }
+
+    entries.reserve(total);
+    for (std::vector<PConfigEntry> &chunk : parsed)
+        entries.insert(entries.end(), chunk.begin(), chunk.end());
+
+    lineNum = line;
+    pos = size;
+    return entries;
+}
+
 const char *PConfig::formatString()
 {
     return "x y vx vy mass radius r g b";
 }
+
+void PConfig::writeBinary(const std::string &path,
+                          const std::vector<PConfigEntry> &entries)
+{
+    std::ofstream ofile(path, std::ios::binary | std::ios::trunc);
+    BinaryHeader header;
+
+    if (ofile.fail())
+        throw std::ios_base::failure(describeError(path));
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.byte_order = byte_order;
+    header.version = version;
+    header.count = entries.size();
+    ofile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    double PConfigEntry::*dfields[] = {
+        &PConfigEntry::rx, &PConfigEntry::ry, &PConfigEntry::vx,
+        &PConfigEntry::vy, &PConfigEntry::radius,
+    };
+    int PConfigEntry::*ifields[] = {
+        &PConfigEntry::mass, &PConfigEntry::r, &PConfigEntry::g,
+        &PConfigEntry::b,
+    };
+
+    for (double PConfigEntry::*field : dfields) {
+        for (const PConfigEntry &entry : entries)
+            ofile.write(reinterpret_cast<const char *>(&(entry.*field)),
+                        sizeof(double));
+    }
+    for (int PConfigEntry::*field : ifields) {
+        for (const PConfigEntry &entry : entries) {
+            int32_t val = entry.*field;
+
+            ofile.write(reinterpret_cast<const char *>(&val), sizeof(val));
+        }
+    }
+
+    ofile.close();
+    if (ofile.fail())
+        throw std::ios_base::failure(describeError(path));
+}
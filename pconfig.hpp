@@ -2,11 +2,12 @@
 #define _PCONFIG_HPP_
 
 #include <string>
-#include <fstream>
-#include <sstream>
+#include <vector>
 #include <memory>
 #include <cerrno>
+#include <cstdint>
 #include <exception>
+#include <stdexcept>
 
 struct PConfigEntry {
     double rx;
@@ -38,39 +39,50 @@ public:
     }
 };
 
-// Quick&dirty config parser.
+/*
+ * Config parser.
+ *
+ * The file is mapped to memory and parsed in place, without copying
+ * lines around. Empty lines and lines starting with # are skipped.
+ * readAll() parses all the entries at once and splits big files into
+ * chunks parsed by several threads; errors are reported the same way
+ * in both cases: the line (from 1) and the column (the number of the
+ * value in the line, from 0) of the first broken value in the file.
+ *
+ * A config can also be stored in binary form (see writeBinary), which
+ * holds the same values in columns and is loaded without any parsing.
+ * The "line" of an error in a binary config is the number of the entry.
+ */
 class PConfig {
 private:
-    int colNum;
+    const char *data;
+    size_t size;
+    size_t pos; // where the next entry starts
     int lineNum;
-    std::ifstream ifile;
+    bool binary;
+    size_t nentries; // in binary config
 
-    template <class T>
-    T readValue(std::istringstream &ss, const std::string &name,
-                T floor, T ceil) {
-        T val;
+    void parseBinary(size_t first, size_t last, PConfigEntry *out) const;
 
-        ss >> val;
-        if (ss.fail())
-            throw PConfigError(lineNum, colNum, name + " was expected next, but " +
-                               "got nothing");
-        if (val < floor)
-            throw PConfigError(lineNum, colNum, name + " can not be less than " +
-                               std::to_string(floor));
-        if (val > ceil)
-            throw PConfigError(lineNum, colNum, name + " can not be greater than " +
-                               std::to_string(ceil));
-
-        colNum++;
-        return val;
-    }
-
-    
 public:
     PConfig(const char *cfg_file);
     virtual ~PConfig();
+
+    PConfig(const PConfig &) = delete;
+    PConfig &operator=(const PConfig &) = delete;
+
+    // the next entry, nullptr at the end of the config
     std::unique_ptr<PConfigEntry> nextEntry();
+
+    // all the entries left in the config, parsed by
+    // @nthreads threads (all the cores by default)
+    std::vector<PConfigEntry> readAll(unsigned nthreads = 0);
+
     static const char *formatString();
+
+    // stores the entries in the binary config format
+    static void writeBinary(const std::string &path,
+                            const std::vector<PConfigEntry> &entries);
 };
 
 #endif /* _PCONFIG_HPP_ */
@@ -0,0 +1,131 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+
+#include "event_log.hpp"
+
+/*
+ * Rebuilds the state of a simulation from its event log (headless -L)
+ * at a given record or time, without simulating anything.
+ */
+
+static void usage(const char *appname)
+{
+    std::cerr << "Usage: " << appname << " [-e <records> | -t <time>] "
+        "[-o <file>] <log>" << std::endl;
+    std::cerr << "  -e: apply the given number of records "
+              << "(all of them by default)" << std::endl;
+    std::cerr << "  -t: apply the records up to the given simulation time"
+              << std::endl;
+    std::cerr << "  -o: write the state of particles to the file "
+              << "(- for stdout)" << std::endl;
+    exit(EXIT_FAILURE);
+}
+
+// the state at @time in the configuration file format, like headless -o
+static void write_state(std::ostream &os, const EventReplay &replay,
+                        double time)
+{
+    const ParticleStore &particles = replay.getParticles();
+    double width = replay.getWidth(), height = replay.getHeight();
+    double mid = (width + height) / 2;
+
+    os << "# state at " << time << std::endl;
+    os << std::setprecision(std::numeric_limits<double>::max_digits10);
+    for (uint32_t i = 0; i < particles.size(); i++) {
+        uint32_t color = particles.getColor(i);
+
+        os << particles.getX(i, time) / width << " "
+           << particles.getY(i, time) / height << " "
+           << particles.getVX(i) / mid << " " << particles.getVY(i) / mid
+           << " " << particles.getMass(i) << " "
+           << particles.getRadius(i) / mid << " " << (color >> 16) << " "
+           << ((color >> 8) & 0xff) << " " << (color & 0xff) << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long long until_records = -1;
+    double until_time = -1.0;
+    const char *output = nullptr;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "e:t:o:")) != -1) {
+        switch (opt) {
+        case 'e':
+            until_records = strtoll(optarg, NULL, 10);
+            break;
+        case 't':
+            until_time = strtod(optarg, NULL);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - optind != 1)
+        usage(argv[0]);
+    if (until_records >= 0 && until_time >= 0) {
+        std::cerr << "Either records (-e) or time (-t) can be given"
+                  << std::endl;
+        usage(argv[0]);
+    }
+
+    try {
+        EventReplay replay(argv[optind]);
+        auto start = std::chrono::steady_clock::now();
+        double time;
+
+        if (until_time >= 0) {
+            replay.seekTime(until_time);
+            time = until_time;
+        }
+        else {
+            replay.seek((until_records >= 0) ? until_records :
+                        std::numeric_limits<uint64_t>::max());
+            time = replay.getTime();
+        }
+
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+        if (output != nullptr) {
+            if (std::string(output) == "-") {
+                write_state(std::cout, replay, time);
+            }
+            else {
+                std::ofstream ofile(output);
+
+                if (ofile.fail())
+                    throw std::ios_base::failure(strerror(errno));
+                write_state(ofile, replay, time);
+            }
+        }
+
+        std::cerr << "particles: " << replay.getParticles().size()
+                  << std::endl;
+        std::cerr << "time: " << time << std::endl;
+        std::cerr << "records: " << replay.getPosition() << std::endl;
+        std::cerr << "wall time: " << elapsed.count() << " s" << std::endl;
+    }
+    catch (EventLogError &e) {
+        std::cerr << "Event log error: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    catch (std::exception &e) {
+        std::cerr << "ERROR: " << e.what() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
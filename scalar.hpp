@@ -0,0 +1,249 @@
+#ifndef _SCALAR_HPP_
+#define _SCALAR_HPP_
+
+#include <cmath>
+#include <cstdint>
+
+/*
+ * Number types the state of the particles can be kept in.
+ *
+ * The engine is built for one of them, double by default; `make
+ * SCALAR=float` keeps positions and velocities in floats (half the
+ * memory and twice as many particles per vector instruction) and `make
+ * SCALAR=fixed` in fixed point numbers, which give the same results on
+ * any machine and with any compiler. Times are always doubles: events
+ * of a long run have to be ordered precisely.
+ *
+ * ScalarPolicy<T> tells the engine how to convert T from and to double
+ * and how to round it.
+ */
+
+// 10^digits, known at compile time
+template <int digits>
+struct Power10 {
+    static const int64_t value = 10 * Power10<digits - 1>::value;
+};
+
+template <>
+struct Power10<0> {
+    static const int64_t value = 1;
+};
+
+/*
+ * Signed fixed point number with 16 bits after the point. Everything is
+ * done on integers, so the results do not depend on the floating point
+ * unit. Products and quotients go through 128 bit integers (a GCC and
+ * Clang extension), the integer part has 47 bits: enough for squared
+ * distances and speeds of any sane box.
+ */
+class Fixed {
+private:
+    int64_t raw;
+
+    typedef __int128 wide;
+
+    static int64_t floorDiv(wide a, wide b) {
+        wide q = a / b;
+
+        return (q * b != a && (a < 0) != (b < 0)) ? q - 1 : q;
+    }
+
+public:
+    static const int frac_bits = 16;
+    static const int64_t one = int64_t(1) << frac_bits;
+
+    Fixed() : raw(0) {}
+    explicit Fixed(int v) : raw(v * one) {}
+
+    static Fixed fromRaw(int64_t raw) {
+        Fixed f;
+
+        f.raw = raw;
+        return f;
+    }
+
+    // the nearest fixed point number
+    static Fixed fromDouble(double v) {
+        return fromRaw(static_cast<int64_t>(std::floor(v * one + 0.5)));
+    }
+
+    // exact, the raw value fits the mantissa
+    double toDouble() const {
+        return raw / static_cast<double>(one);
+    }
+
+    int64_t getRaw() const {
+        return raw;
+    }
+
+    Fixed operator-() const {
+        return fromRaw(-raw);
+    }
+
+    Fixed operator+(Fixed f) const {
+        return fromRaw(raw + f.raw);
+    }
+
+    Fixed operator-(Fixed f) const {
+        return fromRaw(raw - f.raw);
+    }
+
+    Fixed operator*(Fixed f) const {
+        return fromRaw(floorDiv(static_cast<wide>(raw) * f.raw, one));
+    }
+
+    Fixed operator/(Fixed f) const {
+        return fromRaw(floorDiv(static_cast<wide>(raw) * one, f.raw));
+    }
+
+    Fixed &operator+=(Fixed f) {
+        raw += f.raw;
+        return *this;
+    }
+
+    Fixed &operator-=(Fixed f) {
+        raw -= f.raw;
+        return *this;
+    }
+
+    bool operator<(Fixed f) const { return raw < f.raw; }
+    bool operator>(Fixed f) const { return raw > f.raw; }
+    bool operator<=(Fixed f) const { return raw <= f.raw; }
+    bool operator>=(Fixed f) const { return raw >= f.raw; }
+    bool operator==(Fixed f) const { return raw == f.raw; }
+    bool operator!=(Fixed f) const { return raw != f.raw; }
+
+    // the largest number whose square is not above this one
+    Fixed sqrt() const;
+
+    // floor((v * 10^digits + 0.5) / 10^digits), the way doubles are
+    // rounded, but exactly
+    template <int digits>
+    Fixed round() const {
+        wide mult = Power10<digits>::value;
+        int64_t r = floorDiv(static_cast<wide>(raw) * mult + one / 2, mult);
+
+        return fromRaw(floorDiv(r, one) * one);
+    }
+};
+
+inline Fixed Fixed::sqrt() const
+{
+    // bit by bit square root of raw * one, which is
+    // the raw value of the result
+    unsigned __int128 v = (raw > 0) ? static_cast<unsigned __int128>(raw) * one : 0;
+    unsigned __int128 res = 0, bit = static_cast<unsigned __int128>(1) << 126;
+
+    while (bit > v)
+        bit >>= 2;
+    while (bit != 0) {
+        if (v >= res + bit) {
+            v -= res + bit;
+            res = (res >> 1) + bit;
+        }
+        else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return fromRaw(static_cast<int64_t>(res));
+}
+
+template <class T>
+struct ScalarPolicy;
+
+template <>
+struct ScalarPolicy<double> {
+    // stored in checkpoints
+    static const uint32_t id = 0;
+
+    static const char *name() {
+        return "double";
+    }
+
+    static double fromDouble(double v) {
+        return v;
+    }
+
+    static double toDouble(double v) {
+        return v;
+    }
+
+    static double sqrt(double v) {
+        return std::sqrt(v);
+    }
+
+    // @digits after the point, the multiplier is a constant
+    template <int digits>
+    static double round(double v) {
+        const int mult = Power10<digits>::value;
+
+        return std::floor((v * mult + 0.5) / mult);
+    }
+};
+
+template <>
+struct ScalarPolicy<float> {
+    static const uint32_t id = 1;
+
+    static const char *name() {
+        return "float";
+    }
+
+    static float fromDouble(double v) {
+        return static_cast<float>(v);
+    }
+
+    static double toDouble(float v) {
+        return v;
+    }
+
+    static float sqrt(float v) {
+        return std::sqrt(v);
+    }
+
+    template <int digits>
+    static float round(float v) {
+        const float mult = Power10<digits>::value;
+
+        return std::floor((v * mult + 0.5f) / mult);
+    }
+};
+
+template <>
+struct ScalarPolicy<Fixed> {
+    static const uint32_t id = 2;
+
+    static const char *name() {
+        return "fixed";
+    }
+
+    static Fixed fromDouble(double v) {
+        return Fixed::fromDouble(v);
+    }
+
+    static double toDouble(Fixed v) {
+        return v.toDouble();
+    }
+
+    static Fixed sqrt(Fixed v) {
+        return v.sqrt();
+    }
+
+    template <int digits>
+    static Fixed round(Fixed v) {
+        return v.round<digits>();
+    }
+};
+
+// the type the engine is built for
+#if defined(SCALAR_FLOAT)
+typedef float Scalar;
+#elif defined(SCALAR_FIXED)
+typedef Fixed Scalar;
+#else
+typedef double Scalar;
+#endif
+
+#endif /* _SCALAR_HPP_ */
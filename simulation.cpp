@@ -1,319 +1,732 @@
 #include <iostream>
 #include <sstream>
-#include <SDL2/SDL.h>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <thread>
 
 #include "simulation.hpp"
+#include "thread_pool.hpp"
 #include "particle.hpp"
 #include "event.hpp"
 
-static const Uint8 background_r = 255;
-static const Uint8 background_g = 255;
-static const Uint8 background_b = 255;
-
-static const int SPEED_MIN = 1;
-static const int SPEED_MAX = 3;
+namespace {
+
+// the earliest event found for a particle so far
+struct Prediction {
+    double time;
+    // the other particle (< N), crossing into the next cell or the
+    // neighbor list (or the interval) expiring (N), or hitting a
+    // vertical (N + 1) or a horisontal (N + 2) wall
+    uint32_t what;
+
+    // Events due at the same time are ordered by what happens,
+    // which is also the order predictCollisions offers them in
+    // without the grid, so the result doesn't depend on which
+    // thread found which event.
+    bool improves(const Prediction &p) const {
+        return (time < p.time) || (time == p.time && what < p.what);
+    }
+};
 
-Simulation::Simulation(int width, int height, int fps)
-{
-    this->width = width;
-    this->height = height;
-    this->fps = fps;
-    is_paused = false;
-    speed = SPEED_MIN;
-    now = 0.0;
-    delay_ms = 1000 / fps;
-    window = nullptr;
-    renderer = nullptr;
+const uint32_t nothing = std::numeric_limits<uint32_t>::max();
 
-    if (SDL_CreateWindowAndRenderer(width, height, 0,
-            &window, &renderer) != 0) {
-        std::ostringstream oss;
+// particles (rows of the pair matrix) handled by a single task
+const uint32_t rows_per_task = 64;
 
-        oss << "Failed to create window (SDL: "
-            << SDL_GetError() << ")";
-        throw SimulationError(oss.str());
-    }
+// the largest particle may be up to the size of the box,
+// the smallest one a single pixel
+const int max_grid_levels = 12;
 
-    resetBackgroundColor();
 }
 
-Simulation::~Simulation()
+Simulation::Simulation(int width, int height)
+    : particles(width, height)
 {
-    if (renderer != nullptr)
-        SDL_DestroyRenderer(renderer);
-    if (window != nullptr)
-        SDL_DestroyWindow(window);
-
-    while (!events.empty()) {
-        Event *ev = events.top();
-        events.pop();
-        delete ev;
-    }
-    while (!particles.empty()) {
-        Particle *p = particles.back();
-        particles.pop_back();
-        delete p;
-    }
+    this->width = width;
+    this->height = height;
+    initialized = false;
+    use_grid = false;
+    hierarchical = true;
+    skin = 0.0;
+    horizon = 0.0;
+    nthreads = std::max(std::thread::hardware_concurrency(), 1u);
+    now = 0.0;
+    nevents = 0;
+    nstale = 0;
+    log = nullptr;
 }
 
 void Simulation::addParticle(double x, double y, double vx, double vy,
                              double radius, int mass, int r, int g, int b)
 {
-    Particle *new_p = new Particle(x, y, vx, vy, radius, mass,
-                                   width, height, r, g, b);
+    Particle new_p(x, y, vx, vy, radius, mass, width, height, r, g, b);
 
     // ensure that new particle does not overlap
     // with existing ones before adding it to the
     // simulation.
-    for (Particle *p : particles) {
-        if (new_p->overlaps(*p)) {
+    for (uint32_t i = 0; i < particles.size(); i++) {
+        if (particles.overlaps(new_p, i)) {
             std::ostringstream oss;
 
-            oss << "Particle " << *new_p << " overlaps with "
-                << "existing particle " << *p;
+            oss << "Particle " << new_p << " overlaps with "
+                << "existing particle ";
+            particles.describe(oss, i);
             throw SimulationError(oss.str());
         }
     }
 
-    particles.push_back(new_p);
+    particles.add(new_p);
 }
 
-void Simulation::tick()
+void Simulation::addParticles(const std::vector<Particle> &batch)
 {
-    // The idea behind event driven simulation is quite
-    // ingenious: we determine the time of all collisions
-    // happening between all particles and walls assuming
-    // that particles move by straight lines at constant
-    // speed without any resistance.
-    //
-    // We keep the collision events arranged by time in priority
-    // queue, so that we always know when and what collisions
-    // are going to happen.
-    //
-    // The expensive calculations have to be done only
-    // once when the priority queue is initialised. By the expensive
-    // calculations I mean the calculation of all collisions between
-    // all available particles O(n^2). Then the event driven model
-    // requires to recalculate new events only after some event (collision)
-    // happens, which requires no more than O(N). That's why this
-    // model is so swift.
-    //
-    // Of course some of the events in the queue have to be cancelled after
-    // the collision event happens (since particle's trajectories change),
-    // that's why the system allows to detect whether the event
-    // is stale/cancelled.
-
-    if (events.empty()) {
-        if (particles.size() == 0) {
-            throw SimulationError("Simulation can not be launched "
-                                  "with 0 particles");
+    uint32_t first = particles.size();
+
+    particles.reserve(first + batch.size());
+    for (const Particle &p : batch)
+        particles.add(p);
+
+    uint32_t n = particles.size();
+    uint32_t ntasks = (n - first + rows_per_task - 1) / rows_per_task;
+    double cell_size = std::max(2.0 * particles.getMaxRadius(),
+        std::sqrt((double)width * height / std::max(n, 1u)));
+    Grid bins(width, height, std::max(cell_size, 1.0));
+
+    for (uint32_t i = 0; i < n; i++)
+        bins.insert(particles, i);
+
+    // Every new particle is tested against the particles with lower
+    // indices only, so the same pair is reported as addParticle would
+    // have done adding them one by one. Each task keeps the first
+    // overlapping pair it finds.
+    std::vector<std::pair<uint32_t, uint32_t>> found(ntasks, {n, n});
+    ThreadPool pool(std::max(std::min(nthreads, ntasks), 1u));
+
+    pool.run(ntasks, [&](size_t task, unsigned) {
+        std::vector<uint32_t> neighbors;
+        uint32_t begin = first + task * rows_per_task;
+        uint32_t end = std::min(begin + rows_per_task, n);
+
+        for (uint32_t k = begin; k < end; k++) {
+            uint32_t other = n;
+
+            neighbors.clear();
+            bins.neighbors(bins.getCell(k), neighbors);
+            for (uint32_t j : neighbors) {
+                if (j < k && j < other && particles.overlaps(k, j))
+                    other = j;
+            }
+
+            if (other < n) {
+                found[task] = {k, other};
+                return;
+            }
         }
+    });
 
-        initializeEvents();
-    }
-    if (is_paused) {
-        SDL_Delay(delay_ms);
-        return;
-    }
-
-    bool enough = false;
-    while (!enough) {
-        Event *ev = events.top();
-
-        events.pop();
-        if (ev->isStale()) {
-            delete ev;
-            continue;
-        }
-
-        // simulation system does time related calculations
-        // in relative time, not absolute. So we have to
-        // translate relative time time to absolute one
-        // and vice versa.
-        moveParticles(ev->getTime() - now);
-        SDL_Delay(simulationTimeToMS(ev->getTime() - now));
-        now = ev->getTime();
-
-        switch (ev->getType()) {
-        case EventType::WallCollision:
-        {
-            // Particle collides a wall. This requires to calculate
-            // the collisions of this particle with all other particles
-            // and walls.
-            WallCollisionEvent *wc_ev = dynamic_cast<WallCollisionEvent*>(ev);
-            wc_ev->getParticle().bounceWall(wc_ev->getWallType());
-            predictCollisions(wc_ev->getParticle());
-            break;
-        }
-
-        case EventType::ParticleCollision:
-        {
-            // Two particles collide each other. This requires to calculate
-            // the collisions of these two particles with all other particles
-            // and walls.
-            ParticleCollisionEvent *pc_ev = dynamic_cast<ParticleCollisionEvent*>(ev);
-            pc_ev->getFirstParticle().bounceParticle(pc_ev->getSecondParticle());
-            predictCollisions(pc_ev->getFirstParticle());
-            predictCollisions(pc_ev->getSecondParticle());
-            break;
-        }
+    for (const std::pair<uint32_t, uint32_t> &pair : found) {
+        if (pair.first < n) {
+            std::ostringstream oss;
 
-        case EventType::Refresh:
-            refresh();
-            enough = true;
-            events.push(new RefreshEvent(now + MSToSimulationTime(delay_ms)));
-            break;
+            oss << "Particle " << batch[pair.first - first] << " overlaps with "
+                << "existing particle ";
+            particles.describe(oss, pair.second);
+            particles.truncate(first);
+            throw SimulationError(oss.str());
         }
-
-        delete ev;
     }
 }
 
-void Simulation::pause()
+void Simulation::reserve(size_t n)
 {
-    is_paused = true;
+    particles.reserve(n);
 }
 
-void Simulation::resume()
+void Simulation::enableGrid(bool hierarchical)
 {
-    is_paused = false;
+    use_grid = true;
+    this->hierarchical = hierarchical;
+    skin = 0.0;
+    horizon = 0.0;
 }
 
-bool Simulation::paused() const
+void Simulation::enableNeighborLists(double skin)
 {
-    return is_paused;
+    if (skin <= 0)
+        throw SimulationError("Skin of the neighbor lists has to be positive");
+
+    this->skin = skin;
+    use_grid = false;
+    horizon = 0.0;
 }
 
-void Simulation::incSpeed()
+void Simulation::enableSweep(double horizon)
 {
-    if (speed < SPEED_MAX)
-        speed++;
+    if (horizon <= 0)
+        throw SimulationError("Horizon of the sweep index has to be positive");
+
+    this->horizon = horizon;
+    use_grid = false;
+    skin = 0.0;
 }
 
-void Simulation::decSpeed()
+void Simulation::setThreads(unsigned nthreads)
 {
-    if (speed > SPEED_MIN)
-        speed--;
+    this->nthreads = std::max(nthreads, 1u);
 }
 
-int Simulation::getSpeed() const
+// The idea behind event driven simulation is quite
+// ingenious: we determine the time of all collisions
+// happening between all particles and walls assuming
+// that particles move by straight lines at constant
+// speed without any resistance.
+//
+// We keep the collision events arranged by time in priority
+// queue, so that we always know when and what collisions
+// are going to happen.
+//
+// The expensive calculations have to be done only
+// once when the priority queue is initialised. By the expensive
+// calculations I mean the calculation of all collisions between
+// all available particles O(n^2). Then the event driven model
+// requires to recalculate new events only after some event (collision)
+// happens, which requires no more than O(N). That's why this
+// model is so swift.
+//
+// Of course some of the events in the queue have to be cancelled after
+// the collision event happens (since particle's trajectories change).
+// We do not keep all the predicted events though, only the earliest
+// one for every particle. When a particle collides, the events of
+// the particles that were about to hit it become stale; such an event
+// is still the earliest moment its particle could take part in
+// anything, so when a stale event comes out of the queue we just
+// predict a new one for its particle.
+double Simulation::nextEventTime()
 {
-    return speed;
+    if (!initialized)
+        initializeEvents();
+
+    while (!events.empty() && isStale(events.top())) {
+        predictCollisions(events.topSlot(), events.top().time);
+        nstale++;
+    }
+
+    if (events.empty())
+        return std::numeric_limits<double>::infinity();
+
+    return events.top().time;
 }
 
-void Simulation::moveParticles(double dt)
+EventType Simulation::processEvent()
 {
-    for (Particle *p: particles)
-        p->move(dt);
+    if (nextEventTime() == std::numeric_limits<double>::infinity())
+        throw SimulationError("There are no events to process");
+
+    Event ev = events.pop();
+
+    // Particles are not moved all together on every event,
+    // each one keeps the time its position was last updated
+    // at and is brought to the current time only when it
+    // takes part in the event.
+    now = ev.time;
+    observables.advance(now);
+    STATS_EVENT(stats, ev.type);
+
+    switch (ev.type) {
+    case EventType::WallCollision:
+        // Particle collides a wall. This requires to calculate
+        // the collisions of this particle with all other particles
+        // and walls.
+        particles.advance(ev.pa, now);
+        observables.wallHit(particles, ev.pa, ev.wtype);
+        particles.bounceWall(ev.pa, ev.wtype);
+        if (log)
+            log->wallBounce(now, particles, ev.pa);
+        predictCollisions(ev.pa, now);
+        break;
+
+    case EventType::CellCrossing:
+        // Particle moves to another grid cell. Its trajectory stays
+        // the same, so the events predicted for other particles
+        // against it are still valid, but it has new neighbors
+        // now, so its own next event has to be predicted again.
+        grid->move(ev.pa, ev.pb);
+        predictCollisions(ev.pa, now);
+        break;
+
+    case EventType::ListExpiry:
+        // The same for the neighbor lists: the particle gets a new
+        // list around the place it's at now, and the particles new
+        // on it may be going to hit it before their next events.
+        lists->rebuild(particles, ev.pa, now);
+        predictCollisions(ev.pa, now);
+        break;
+
+    case EventType::IntervalExpiry:
+        // and for the sweep index
+        sweep->update(particles, ev.pa, now);
+        predictCollisions(ev.pa, now);
+        break;
+
+    case EventType::ParticleCollision:
+        // Two particles collide each other. This requires to calculate
+        // the collisions of these two particles with all other particles
+        // and walls.
+        particles.advance(ev.pa, now);
+        particles.advance(ev.pb, now);
+        observables.remove(particles, ev.pa);
+        observables.remove(particles, ev.pb);
+        particles.bounceParticle(ev.pa, ev.pb);
+        observables.add(particles, ev.pa);
+        observables.add(particles, ev.pb);
+        observables.collision();
+        if (log)
+            log->collision(now, particles, ev.pa, ev.pb);
+        predictCollisions(ev.pa, now);
+        predictCollisions(ev.pb, now);
+        break;
+
+    case EventType::Refresh:
+        // somebody wants to look at the particles
+        syncParticles();
+        return ev.type;
+    }
+
+    nevents++;
+    return ev.type;
 }
 
-void Simulation::refresh()
+void Simulation::advance(double time)
 {
-    SDL_RenderClear(renderer);
-    for (Particle *p : particles) {
-        SDL_SetRenderDrawColor(renderer, p->getR(), p->getG(),
-                               p->getB(), 255);
-        drawDisk(p->getX(), p->getY(), p->getRadius());
-        resetBackgroundColor();
-    }
+    if (time < now)
+        throw SimulationError("Simulation can not go back in time");
+    if (!initialized)
+        initializeEvents();
 
-    SDL_RenderPresent(renderer);
+    // the refresh event has the last slot, so it comes out of
+    // the queue after all the other events due at the same time
+    events.update(refreshSlot(), Event::refresh(time));
+    while (processEvent() != EventType::Refresh)
+        ;
 }
 
-// SDL does not provide primitives for drawing lines
-// and circles, so we use good old Bresenham's black
-// magic to cast these shapes.
-void Simulation::drawDisk(int x0, int y0, int radius)
+void Simulation::runUntil(double time)
 {
-    int x = 0, y = radius, d = 3 - 2 * radius;
+    if (time < now)
+        throw SimulationError("Simulation can not go back in time");
 
-    while (x <= y) {
-        drawLine(x0 + x, y0 + y, x0 + x, y0 - y);
-        drawLine(x0 - x, y0 + y, x0 - x, y0 - y);
-        drawLine(x0 + y, y0 + x, x0 + y, y0 - x);
-        drawLine(x0 - y, y0 + x, x0 - y, y0 - x);
+    while (nextEventTime() <= time)
+        processEvent();
+}
 
-        if (d <= 0)
-            d += 4 * x + 6;
-        else {
-            d += 4 * (x - y) + 10;
-            y--;
-        }
+uint64_t Simulation::run(uint64_t n)
+{
+    uint64_t done;
 
-        x++;
+    for (done = 0; done < n; done++) {
+        if (nextEventTime() == std::numeric_limits<double>::infinity())
+            break;
+        processEvent();
     }
+
+    syncParticles();
+    return done;
 }
 
-// Expecto Patronum!
-void Simulation::drawLine(int x0, int y0, int x1, int y1)
+void Simulation::printStats(std::ostream &os) const
 {
-    int delta_x = abs(x1 - x0);
-    int delta_y = -abs(y1 - y0);
-    int sx = (x1 > x0) ? 1 : -1;
-    int sy = (y1 > y0) ? 1 : -1;
-    int error = delta_x + delta_y;
-
-    for (int x = x0, y = y0; x != x1 || y != y1;) {
-        SDL_RenderDrawPoint(renderer, x, y);
-
-        int err = error * 2;
-        if (err >= delta_y) {
-            error += delta_y;
-            x += sx;
-        }
-        if (err <= delta_x) {
-            error += delta_x;
-            y += sy;
-        }
-    }
+    os << "time " << now << " events " << nevents << " stale " << nstale
+       << " queue " << events.size() << " peak_queue " << events.getPeakSize()
+       << " ";
+    stats.print(os);
+    os << std::endl;
 }
 
-void Simulation::resetBackgroundColor()
+size_t Simulation::memoryUsage() const
 {
-    SDL_SetRenderDrawColor(renderer, background_r, background_g,
-                           background_b, 255);
+    size_t bytes = particles.memoryUsage() + events.memoryUsage() +
+        candidates.capacity() * sizeof(uint32_t) +
+        times.capacity() * sizeof(double);
+
+    if (grid)
+        bytes += grid->memoryUsage();
+    if (lists)
+        bytes += lists->memoryUsage();
+    if (sweep)
+        bytes += sweep->memoryUsage();
+    return bytes;
 }
 
-void Simulation::initializeEvents()
+// the event is considered to be stale if any of its
+// particles collides something before it happens.
+bool Simulation::isStale(const Event &ev) const
 {
-    for (Particle *p : particles)
-        predictCollisions(*p);
+    switch (ev.type) {
+    case EventType::WallCollision:
+    case EventType::CellCrossing:
+    case EventType::ListExpiry:
+    case EventType::IntervalExpiry:
+        return (ev.pa_rev != particles.getRevision(ev.pa));
+    case EventType::ParticleCollision:
+        return ((ev.pa_rev != particles.getRevision(ev.pa)) ||
+                (ev.pb_rev != particles.getRevision(ev.pb)));
+    case EventType::Refresh:
+        break;
+    }
 
-    events.push(new RefreshEvent(now));
+    // refresh can not be cancelled
+    return false;
 }
 
-void Simulation::predictCollisions(Particle &particle)
+void Simulation::syncParticles()
 {
-    for (Particle *p : particles) {
-        double dt = particle.collidesParticle(*p);
+    STATS_TIMER(stats, Phase::Sync);
 
-        if (dt < 0)
-            continue;
+    if (log)
+        log->sync(now);
+    for (uint32_t i = 0; i < particles.size(); i++)
+        particles.advance(i, now);
+}
 
-        events.push(new ParticleCollisionEvent(now + dt, particle, *p));
+void Simulation::initializeEvents()
+{
+    if (particles.size() == 0) {
+        throw SimulationError("Simulation can not be launched "
+                              "with 0 particles");
+    }
+
+    if (use_grid)
+        initializeGrid();
+    if (skin > 0) {
+        lists.reset(new NeighborLists(skin));
+        lists->build(particles, now);
+    }
+    if (horizon > 0) {
+        sweep.reset(new SweepIndex(horizon));
+        sweep->build(particles, now);
     }
 
-    addWallCollisionEvent(particle, WallType::Vertical);
-    addWallCollisionEvent(particle, WallType::Horisontal);    
+    events.reset(particles.size() + 1);
+    predictAll();
+    resetObservables();
+    initialized = true;
 }
 
-void Simulation::addWallCollisionEvent(Particle &p, WallType wtype)
+void Simulation::resetObservables()
 {
-    double dt;
+    observables.reset(particles, 2.0 * (width + height), now);
+}
 
-    dt = p.collidesWall(wtype);
-    if (dt < 0)
-        return;
+uint32_t Simulation::refreshSlot() const
+{
+    return particles.size();
+}
+
+void Simulation::initializeGrid()
+{
+    int max_radius = particles.getMaxRadius();
+    double area_size = std::sqrt((double)width * height / particles.size());
+    int nlevels = 1;
+
+    // Cells have to be at least as large as the diameter of
+    // the biggest particle, otherwise touching particles could
+    // end up in cells that are not adjacent. Making them smaller
+    // than the area per particle just spawns more crossing events
+    // without reducing the number of neighbors to test.
+    double cell_size = std::max(std::max(2.0 * max_radius, area_size), 1.0);
+
+    // The smaller particles get levels of smaller cells, down to
+    // the diameter of the smallest one (and the area per particle
+    // still). Systems with radii within a factor of two of each
+    // other have a single level.
+    double smallest = std::max(std::max(2.0 * particles.getMinRadius(),
+                                        area_size), 1.0);
+
+    while (hierarchical && nlevels < max_grid_levels &&
+           cell_size / 2 >= smallest) {
+        cell_size /= 2;
+        nlevels++;
+    }
 
-    events.push(new WallCollisionEvent(now + dt, p, wtype));
+    grid.reset(new Grid(width, height, cell_size, nlevels));
+    for (uint32_t i = 0; i < particles.size(); i++)
+        grid->insert(particles, i);
 }
 
-int Simulation::simulationTimeToMS(double sim_time) const
+// Predicts the first event of every particle before the simulation
+// starts. Calling predictCollisions for every particle would test each
+// pair of particles twice; here the particles are split into rows, the
+// pairs (i, j) with i < j of a row are tested once and the result goes
+// to both particles. Rows are spread over a pool of threads, each one
+// keeping the earliest events it found in its own buffer, then the
+// buffers are merged and the queue is built at once.
+void Simulation::predictAll()
 {
-    return 60 / speed * sim_time;
+    STATS_TIMER(stats, Phase::InitialPrediction);
+    uint32_t n = particles.size();
+    uint32_t ntasks = (n + rows_per_task - 1) / rows_per_task;
+    ThreadPool pool(std::min(nthreads, ntasks));
+    std::vector<std::vector<Prediction>> found(pool.size());
+    std::vector<std::vector<uint32_t>> candidates(pool.size());
+    std::vector<std::vector<double>> times(pool.size());
+    std::vector<int> crossing(grid ? n : 0);
+    std::vector<uint64_t> pair_tests(pool.size(), 0);
+
+    // buffers of the other threads are allocated by the
+    // threads themselves when they get their first task
+    found[0].assign(n, Prediction{0.0, nothing});
+
+    pool.run(ntasks, [&](size_t task, unsigned thread) {
+        std::vector<Prediction> &mine = found[thread];
+        std::vector<uint32_t> &cands = candidates[thread];
+        std::vector<double> &ts = times[thread];
+        uint32_t first = task * rows_per_task;
+        uint32_t last = std::min(first + rows_per_task, n);
+
+        if (mine.empty())
+            mine.assign(n, Prediction{0.0, nothing});
+
+        auto offer = [&](uint32_t i, double time, uint32_t what) {
+            Prediction p = {std::max(time, now), what};
+
+            if (mine[i].what == nothing || p.improves(mine[i]))
+                mine[i] = p;
+        };
+
+        for (uint32_t i = first; i < last; i++) {
+            // pairs (i, j) with j > i
+            size_t count;
+
+            if (grid) {
+                cands.clear();
+                grid->neighbors(grid->getCell(i), cands);
+                cands.erase(std::remove_if(cands.begin(), cands.end(),
+                                           [i](uint32_t j) { return j <= i; }),
+                            cands.end());
+                count = cands.size();
+                ts.resize(count);
+                particles.collidesParticles(i, cands.data(), count, ts.data());
+            }
+            else if (lists) {
+                const std::vector<uint32_t> &list = lists->get(i);
+
+                cands.assign(std::upper_bound(list.begin(), list.end(), i),
+                             list.end());
+                count = cands.size();
+                ts.resize(count);
+                particles.collidesParticles(i, cands.data(), count, ts.data());
+            }
+            else if (sweep) {
+                cands.clear();
+                sweep->candidates(particles, i, cands);
+                cands.erase(std::remove_if(cands.begin(), cands.end(),
+                                           [i](uint32_t j) { return j < i; }),
+                            cands.end());
+                count = cands.size();
+                ts.resize(count);
+                particles.collidesParticles(i, cands.data(), count, ts.data());
+            }
+            else {
+                count = n - i - 1;
+                ts.resize(count);
+                particles.collidesParticleRange(i, i + 1, n, ts.data());
+            }
+            pair_tests[thread] += count;
+
+            for (size_t k = 0; k < count; k++) {
+                uint32_t j = (grid || lists || sweep) ? cands[k] : i + 1 + k;
+
+                if (ts[k] >= 0) {
+                    offer(i, ts[k], j);
+                    offer(j, ts[k], i);
+                }
+            }
+
+            double time;
+            if (grid) {
+                time = grid->predictCrossing(particles, i, crossing[i]);
+                if (time >= 0)
+                    offer(i, time, n);
+            }
+            else if (lists) {
+                time = lists->predictExpiry(particles, i);
+                if (time >= 0)
+                    offer(i, time, n);
+            }
+            else if (sweep) {
+                time = sweep->predictExpiry(particles, i);
+                if (time >= 0)
+                    offer(i, time, n);
+            }
+
+            time = particles.collidesWall(i, WallType::Vertical);
+            if (time >= 0)
+                offer(i, time, n + 1);
+            time = particles.collidesWall(i, WallType::Horisontal);
+            if (time >= 0)
+                offer(i, time, n + 2);
+        }
+    });
+
+    for (uint64_t count : pair_tests)
+        STATS_ADD(stats, pair_tests, count);
+
+    // merge the buffers of all the threads into the first one
+    pool.run(ntasks, [&](size_t task, unsigned) {
+        uint32_t first = task * rows_per_task;
+        uint32_t last = std::min(first + rows_per_task, n);
+        std::vector<Prediction> &best = found[0];
+
+        for (size_t k = 1; k < found.size(); k++) {
+            if (found[k].empty())
+                continue;
+
+            for (uint32_t i = first; i < last; i++) {
+                const Prediction &p = found[k][i];
+
+                if (p.what != nothing &&
+                    (best[i].what == nothing || p.improves(best[i]))) {
+                    best[i] = p;
+                }
+            }
+        }
+    });
+
+    for (uint32_t i = 0; i < n; i++) {
+        const Prediction &p = found[0][i];
+        uint32_t rev = particles.getRevision(i);
+
+        if (p.what == nothing) {
+            continue;
+        }
+        else if (p.what < n) {
+            events.put(i, Event::particleCollision(p.time, i, rev, p.what,
+                                                   particles.getRevision(p.what)));
+        }
+        else if (p.what == n && grid) {
+            events.put(i, Event::cellCrossing(p.time, i, rev, crossing[i]));
+        }
+        else if (p.what == n && lists) {
+            events.put(i, Event::listExpiry(p.time, i, rev));
+        }
+        else if (p.what == n) {
+            events.put(i, Event::intervalExpiry(p.time, i, rev));
+        }
+        else {
+            WallType wtype = (p.what == n + 1) ?
+                WallType::Vertical : WallType::Horisontal;
+
+            events.put(i, Event::wallCollision(p.time, i, rev, wtype));
+        }
+    }
+
+    events.heapify();
 }
 
-double Simulation::MSToSimulationTime(int ms) const
+void Simulation::predictCollisions(uint32_t i, double from)
 {
-    return (double)ms / 60 * speed;
+    STATS_DETAILED_TIMER(stats, Phase::Prediction);
+    STATS_ADD(stats, predictions, 1);
+
+    // We keep only the earliest event of the particle in the
+    // queue, so find the closest one among all possible collisions.
+    uint32_t rev = particles.getRevision(i);
+    double time;
+    Event next;
+    bool found = false;
+
+    auto offer = [&](const Event &ev) {
+        if (!found || ev.time < next.time) {
+            next = ev;
+            found = true;
+        }
+    };
+
+    auto predict = [&](uint32_t j, double t) {
+        if (t < 0)
+            return;
+
+        // a collision predicted from positions known at some moment
+        // in the past can not be due before @from (except for the
+        // rounding errors).
+        double time = std::max(t, from);
+        offer(Event::particleCollision(time, i, rev,
+                                       j, particles.getRevision(j)));
+
+        // The collision may also be the earliest event for the other
+        // particle. Even if it isn't the earliest one for this particle
+        // it's fine to put it to the other particle's slot: if this
+        // particle collides something before, the event becomes stale
+        // and the other particle gets a new prediction at that time.
+        const Event *pending = events.get(j);
+        if (pending == nullptr || time < pending->time) {
+            events.update(j, Event::particleCollision(time, j,
+                                                      particles.getRevision(j),
+                                                      i, rev));
+        }
+    };
+
+    // the collision times are computed all at once by the
+    // batch kernel before going through them.
+    if (grid) {
+        candidates.clear();
+        grid->neighbors(grid->getCell(i), candidates);
+        times.resize(candidates.size());
+        particles.collidesParticles(i, candidates.data(), candidates.size(),
+                                    times.data());
+        STATS_ADD(stats, pair_tests, candidates.size());
+        for (size_t k = 0; k < candidates.size(); k++)
+            predict(candidates[k], times[k]);
+
+        int cell;
+        time = grid->predictCrossing(particles, i, cell);
+        if (time >= 0)
+            offer(Event::cellCrossing(std::max(time, from), i, rev, cell));
+    }
+    else if (lists) {
+        const std::vector<uint32_t> &list = lists->get(i);
+
+        times.resize(list.size());
+        particles.collidesParticles(i, list.data(), list.size(), times.data());
+        STATS_ADD(stats, pair_tests, list.size());
+        for (size_t k = 0; k < list.size(); k++)
+            predict(list[k], times[k]);
+
+        time = lists->predictExpiry(particles, i);
+        if (time >= 0)
+            offer(Event::listExpiry(std::max(time, from), i, rev));
+    }
+    else if (sweep) {
+        candidates.clear();
+        sweep->candidates(particles, i, candidates);
+        times.resize(candidates.size());
+        particles.collidesParticles(i, candidates.data(), candidates.size(),
+                                    times.data());
+        STATS_ADD(stats, pair_tests, candidates.size());
+        for (size_t k = 0; k < candidates.size(); k++)
+            predict(candidates[k], times[k]);
+
+        time = sweep->predictExpiry(particles, i);
+        if (time >= 0)
+            offer(Event::intervalExpiry(std::max(time, from), i, rev));
+    }
+    else {
+        times.resize(particles.size());
+        particles.collidesParticleRange(i, 0, particles.size(), times.data());
+        STATS_ADD(stats, pair_tests, particles.size());
+        for (uint32_t j = 0; j < particles.size(); j++)
+            predict(j, times[j]);
+    }
+
+    for (WallType wtype : {WallType::Vertical, WallType::Horisontal}) {
+        time = particles.collidesWall(i, wtype);
+        if (time >= 0)
+            offer(Event::wallCollision(std::max(time, from), i, rev, wtype));
+    }
+
+    if (found)
+        events.update(i, next);
+    else
+        events.remove(i);
 }
@@ -1,12 +1,21 @@
 #ifndef _SIMULATION_HPP_
 #define _SIMULATION_HPP_
 
-#include <queue>
 #include <vector>
 #include <memory>
 #include <exception>
-#include <SDL2/SDL.h>
+#include <stdexcept>
+#include <string>
+#include <ostream>
 #include "event.hpp"
+#include "event_queue.hpp"
+#include "particle_store.hpp"
+#include "grid.hpp"
+#include "neighbor_lists.hpp"
+#include "sweep_index.hpp"
+#include "observables.hpp"
+#include "stats.hpp"
+#include "event_log.hpp"
 
 class SimulationError : public std::runtime_error {
 public:
@@ -15,53 +24,183 @@ public:
     virtual ~SimulationError() {};
 };
 
+/*
+ * The physics engine: keeps particles and the queue of events
+ * and plays the events one after another. It does not draw
+ * anything nor waits for anything, so it runs as fast as it
+ * can; see Viewer for showing it on the screen.
+ */
 class Simulation {
 private:
+    // saves and restores the state directly
+    friend class Checkpoint;
+    // plays the events on several threads
+    friend class ParallelEngine;
+
     int width;
     int height;
-    int fps;
-    int speed;
-    int delay_ms;
     double now;
-    SDL_Window *window;
-    SDL_Renderer *renderer;
-    std::vector<Particle *> particles;
-    bool is_paused;
-
-    // Comparator for priority queue making it a min queue.
-    class EventsCompare {
-    public:
-        bool operator() (const Event *ev1, const Event *ev2) const {
-            return std::less<double>()(ev2->getTime(), ev1->getTime());
-        };
-    };
-
-    // priority queue in C++ is so bloody insane
-    std::priority_queue<Event*, std::vector<Event*>, EventsCompare> events;
-
-    void moveParticles(double dt);
-    void refresh();
-    void drawLine(int x0, int y0, int x1, int y1);
-    void drawDisk(int x0, int y0, int radius);
-    void resetBackgroundColor();
+    uint64_t nevents;
+    uint64_t nstale;
+    bool initialized;
+    ParticleStore particles;
+    bool use_grid;
+    bool hierarchical; // the grid may have several levels
+    std::unique_ptr<Grid> grid;
+    // skin of the neighbor lists, 0 if they are not used
+    double skin;
+    std::unique_ptr<NeighborLists> lists;
+    // horizon of the sweep index, 0 if it's not used
+    double horizon;
+    std::unique_ptr<SweepIndex> sweep;
+    Observables observables;
+    Stats stats;
+    EventLogWriter *log;
+
+    // number of threads predicting the initial events
+    unsigned nthreads;
+
+    // Every particle has a slot in the queue holding the earliest
+    // event predicted for it; the last slot is for refresh events.
+    EventQueue events;
+
+    // scratch buffers for collision prediction
+    std::vector<uint32_t> candidates;
+    std::vector<double> times;
+
+    void syncParticles();
     void initializeEvents();
-    void addWallCollisionEvent(Particle &p, WallType wtype);
-    void predictCollisions(Particle &p);
-    int simulationTimeToMS(double sim_time) const;
-    double MSToSimulationTime(int ms) const;
+    void initializeGrid();
+    uint32_t refreshSlot() const;
+    bool isStale(const Event &ev) const;
+    // Predicts the next event of particle @i; nothing can happen to it
+    // before @from: that's the current time after an event, or the time
+    // of the stale event it replaces (which does not depend on what the
+    // other particles far away did meanwhile).
+    void predictCollisions(uint32_t i, double from);
+    void predictAll();
+    void resetObservables();
 
 public:
-    Simulation(int width, int height, int tick_time_ms);
-    virtual ~Simulation();
+    Simulation(int width, int height);
+    virtual ~Simulation() {};
     void addParticle(double x, double y, double vx, double vy,
                      double radius, int mass, int r, int g, int b);
-    bool paused() const;
-    void pause();
-    void resume();
-    void incSpeed();
-    void decSpeed();
-    int getSpeed() const;
-    void tick();
+
+    // Adds many particles at once. Unlike addParticle it does not test
+    // every new particle against all the others, the particles are
+    // binned into a grid and only the ones in adjacent cells are tested,
+    // so the whole batch is checked in linear time. Nothing is added if
+    // any of the particles overlaps with another one.
+    void addParticles(const std::vector<Particle> &batch);
+
+    // Predicts collisions with the particles in the neighboring cells
+    // of a grid (see grid.hpp). Without @hierarchical the grid has a
+    // single level even if the radii of the particles differ a lot.
+    void enableGrid(bool hierarchical = true);
+
+    // Predicts collisions with the particles on neighbor lists instead
+    // of all the particles (see neighbor_lists.hpp). A larger @skin
+    // makes longer lists which expire less often. It replaces the grid.
+    void enableNeighborLists(double skin);
+
+    // Predicts collisions with the particles found by sweeping the
+    // intervals they take along x (see sweep_index.hpp). A larger
+    // @horizon makes wider intervals which expire less often. It
+    // replaces the grid and the neighbor lists.
+    void enableSweep(double horizon);
+
+    // makes room for @n particles in advance
+    void reserve(size_t n);
+
+    // sets the number of threads used to predict the initial events,
+    // all the cores are used by default.
+    void setThreads(unsigned nthreads);
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    // current simulation time
+    double getTime() const {
+        return now;
+    }
+
+    // number of collisions, cell crossings and list (or interval)
+    // expiries processed so far
+    uint64_t getEventCount() const {
+        return nevents;
+    }
+
+    // number of stale events thrown out of the queue so far
+    uint64_t getStaleCount() const {
+        return nstale;
+    }
+
+    // the largest number of events the queue ever held
+    size_t getPeakQueueSize() const {
+        return events.getPeakSize();
+    }
+
+    // bytes allocated by the particles, the queue and the broadphase
+    size_t memoryUsage() const;
+
+    const ParticleStore &getParticles() const {
+        return particles;
+    }
+
+    // kinetic energy, pressure etc., measured from the first event
+    Observables &getObservables() {
+        return observables;
+    }
+
+    const Observables &getObservables() const {
+        return observables;
+    }
+
+    // counters and timers of the engine (see stats.hpp)
+    Stats &getStats() {
+        return stats;
+    }
+
+    const Stats &getStats() const {
+        return stats;
+    }
+
+    // one line of stats: the engine's counters, the queue and timers
+    void printStats(std::ostream &os) const;
+
+    // writes every event changing the state from now on to @log
+    // (nullptr stops logging); the log has to be opened with the
+    // current state of the particles.
+    void setEventLog(EventLogWriter *log) {
+        this->log = log;
+    }
+
+    // the time of the next event (infinity if nothing is ever
+    // going to happen)
+    double nextEventTime();
+
+    // processes the next event and returns its type
+    EventType processEvent();
+
+    // processes all the events up to the given time and
+    // brings all the particles to that time
+    void advance(double time);
+
+    // processes all the events due up to the given time, but unlike
+    // advance() leaves the particles where they are: their positions
+    // at that time can be got by ParticleStore::getX/getY(i, time).
+    void runUntil(double time);
+
+    // processes @n events (or less, if nothing else is ever going
+    // to happen) and brings all the particles to the current time;
+    // returns the number of processed events.
+    uint64_t run(uint64_t n);
 };
 
 #endif /* _SIMULATION_HPP_ */
@@ -0,0 +1,38 @@
+#include "snapshot.hpp"
+
+namespace {
+
+const unsigned fresh = 4;
+const unsigned index_mask = 3;
+
+}
+
+SnapshotBuffer::SnapshotBuffer(size_t nparticles)
+    : middle(1)
+{
+    for (Snapshot &snapshot : snapshots) {
+        snapshot.time = 0;
+        snapshot.x.assign(nparticles, 0);
+        snapshot.y.assign(nparticles, 0);
+    }
+
+    back = 0;
+    front = 2;
+}
+
+void SnapshotBuffer::publish()
+{
+    // release the back snapshot to the drawing side,
+    // acquire the one it's done with (if any)
+    back = middle.exchange(back | fresh, std::memory_order_acq_rel) &
+        index_mask;
+}
+
+bool SnapshotBuffer::acquire()
+{
+    if (!(middle.load(std::memory_order_relaxed) & fresh))
+        return false;
+
+    front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+    return true;
+}
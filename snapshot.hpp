@@ -0,0 +1,54 @@
+#ifndef _SNAPSHOT_HPP_
+#define _SNAPSHOT_HPP_
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// positions of all particles (in pixels) at some moment of time
+struct Snapshot {
+    double time;
+    std::vector<int32_t> x;
+    std::vector<int32_t> y;
+};
+
+/*
+ * Hands snapshots from the simulation over to the thread drawing them
+ * without any locks (triple buffering). The simulation fills the back
+ * snapshot and publishes it; the drawing thread takes the latest
+ * published one as its front snapshot. Neither side ever waits for
+ * the other: a snapshot published before the previous one was taken
+ * replaces it, and a snapshot being drawn is never written to.
+ *
+ * There must be exactly one thread on each side.
+ */
+class SnapshotBuffer {
+private:
+    Snapshot snapshots[3];
+    // the snapshot between the two sides, and whether it's
+    // been published after the front one was taken
+    std::atomic<unsigned> middle;
+    unsigned back, front;
+
+public:
+    SnapshotBuffer(size_t nparticles);
+
+    SnapshotBuffer(const SnapshotBuffer &) = delete;
+    SnapshotBuffer &operator=(const SnapshotBuffer &) = delete;
+
+    // the simulation side
+    Snapshot &getBack() {
+        return snapshots[back];
+    }
+    void publish();
+
+    // the drawing side: makes the latest snapshot the front one,
+    // false if nothing has been published since the last call
+    bool acquire();
+    const Snapshot &getFront() const {
+        return snapshots[front];
+    }
+};
+
+#endif /* _SNAPSHOT_HPP_ */
@@ -0,0 +1,122 @@
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include "stats.hpp"
+
+namespace {
+
+const char *event_names[Stats::nevent_types] = {
+    "refresh", "wall", "collision", "crossing", "expiry",
+    "interval",
+};
+
+const char *phase_names[Stats::nphases] = {
+    "initial_prediction", "prediction", "sync", "refresh",
+};
+
+}
+
+Stats::Stats()
+    : epoch(Clock::now())
+{
+    for (uint64_t &n : events)
+        n = 0;
+    predictions = pair_tests = 0;
+
+    for (size_t k = 0; k < nphases; k++) {
+        times[k] = Clock::duration::zero();
+        calls[k] = 0;
+    }
+
+    trace_limit = 0;
+    detailed = false;
+}
+
+void Stats::addTime(Phase phase, Clock::time_point start,
+                    Clock::time_point end)
+{
+    size_t k = (size_t)phase;
+
+    times[k] += end - start;
+    calls[k]++;
+
+    if (trace.size() < trace_limit) {
+        trace.push_back(Record{
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                start - epoch).count(),
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                end - start).count(),
+            phase});
+    }
+}
+
+double Stats::getTime(Phase phase) const
+{
+    return std::chrono::duration<double>(times[(size_t)phase]).count();
+}
+
+uint64_t Stats::getCalls(Phase phase) const
+{
+    return calls[(size_t)phase];
+}
+
+void Stats::startTrace(size_t limit)
+{
+    trace_limit = limit;
+    trace.reserve(limit);
+    detailed = true;
+}
+
+const char *Stats::phaseName(Phase phase)
+{
+    return phase_names[(size_t)phase];
+}
+
+void Stats::writeTrace(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::trunc);
+
+    if (file.fail())
+        throw std::runtime_error(path + ": " + strerror(errno));
+
+    // complete ("X") events, times are in microseconds
+    file << "{\"traceEvents\":[";
+    file << std::fixed << std::setprecision(3);
+    for (size_t k = 0; k < trace.size(); k++) {
+        const Record &r = trace[k];
+
+        file << (k ? ",\n" : "\n")
+             << "{\"name\":\"" << phaseName(r.phase) << "\",\"ph\":\"X\","
+             << "\"ts\":" << r.start / 1000.0 << ","
+             << "\"dur\":" << r.duration / 1000.0 << ","
+             << "\"pid\":1,\"tid\":1}";
+    }
+    file << "\n],\"displayTimeUnit\":\"ns\"}\n";
+
+    file.close();
+    if (file.fail())
+        throw std::runtime_error(path + ": " + strerror(errno));
+}
+
+void Stats::print(std::ostream &os) const
+{
+    std::ios_base::fmtflags flags = os.flags();
+    std::streamsize precision = os.precision();
+
+    for (size_t k = 0; k < nevent_types; k++)
+        os << event_names[k] << " " << events[k] << " ";
+    os << "predictions " << predictions
+       << " pair_tests " << pair_tests;
+
+    os << std::setprecision(4);
+    for (size_t k = 0; k < nphases; k++) {
+        if (calls[k] == 0)
+            continue;
+        os << " " << phase_names[k] << "_s "
+           << std::chrono::duration<double>(times[k]).count();
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
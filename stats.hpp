@@ -0,0 +1,122 @@
+#ifndef _STATS_HPP_
+#define _STATS_HPP_
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <ostream>
+#include <cstdint>
+#include "event.hpp"
+
+/*
+ * Counters and timers of the engine: how many events of every type
+ * were processed, how many predictions and pair tests they took and
+ * how much time went into each phase. Timed phases can also be
+ * recorded one by one and written as a Chrome trace (chrome://tracing
+ * or Perfetto open it).
+ *
+ * Everything is updated through the STATS_* macros below, building
+ * with -DNO_STATS (make STATS=0) removes them from the engine
+ * altogether. The counters are cheap, but reading the clock twice for
+ * every prediction is not: the phases done once per event are only
+ * timed while a trace is recorded or detailed timing is turned on.
+ * A Stats object is not thread safe, it belongs to the thread that
+ * updates it.
+ */
+
+enum class Phase : uint8_t {
+    InitialPrediction, // predicting the first events of all particles
+    Prediction, // predicting the next event of a particle (detailed)
+    Sync, // bringing all particles to the current time
+    Refresh, // drawing a frame
+};
+
+class Stats {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t nevent_types = 6;
+    static const size_t nphases = 4;
+
+    uint64_t events[nevent_types]; // by EventType
+    uint64_t predictions;
+    uint64_t pair_tests;
+
+    Stats();
+
+    void addTime(Phase phase, Clock::time_point start, Clock::time_point end);
+
+    // total time spent in the phase, in seconds
+    double getTime(Phase phase) const;
+    uint64_t getCalls(Phase phase) const;
+
+    // starts recording the timed phases, up to @limit of them
+    // (a record takes 24 bytes), detailed timing is turned on too
+    void startTrace(size_t limit);
+
+    // times the phases done once per event as well
+    void setDetailedTiming(bool on) {
+        detailed = on;
+    }
+
+    bool isTimingDetailed() const {
+        return detailed;
+    }
+
+    // writes the recorded phases as a Chrome trace
+    void writeTrace(const std::string &path) const;
+
+    // one line with all the counters and timers
+    void print(std::ostream &os) const;
+
+    static const char *phaseName(Phase phase);
+
+private:
+    struct Record {
+        int64_t start, duration; // ns since the stats were created
+        Phase phase;
+    };
+
+    Clock::time_point epoch;
+    Clock::duration times[nphases];
+    uint64_t calls[nphases];
+    std::vector<Record> trace;
+    size_t trace_limit;
+    bool detailed;
+};
+
+// measures the time till the end of the scope
+class ScopedTimer {
+private:
+    Stats &stats;
+    Phase phase;
+    bool on;
+    Stats::Clock::time_point start;
+
+public:
+    ScopedTimer(Stats &stats, Phase phase, bool on = true)
+        : stats(stats), phase(phase), on(on) {
+        if (on)
+            start = Stats::Clock::now();
+    }
+
+    ~ScopedTimer() {
+        if (on)
+            stats.addTime(phase, start, Stats::Clock::now());
+    }
+};
+
+#ifdef NO_STATS
+#define STATS_ADD(stats, counter, n) ((void)(n))
+#define STATS_EVENT(stats, type) do {} while (0)
+#define STATS_TIMER(stats, phase) do {} while (0)
+#define STATS_DETAILED_TIMER(stats, phase) do {} while (0)
+#else
+#define STATS_ADD(stats, counter, n) ((stats).counter += (n))
+#define STATS_EVENT(stats, type) ((stats).events[(size_t)(type)]++)
+#define STATS_TIMER(stats, phase) ScopedTimer stats_timer_(stats, phase)
+#define STATS_DETAILED_TIMER(stats, phase) \
+    ScopedTimer stats_timer_(stats, phase, (stats).isTimingDetailed())
+#endif
+
+#endif /* _STATS_HPP_ */
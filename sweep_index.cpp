@@ -0,0 +1,120 @@
+#include <algorithm>
+#include "sweep_index.hpp"
+
+SweepIndex::SweepIndex(double horizon)
+{
+    this->horizon = horizon;
+    max_width = 0.0;
+}
+
+size_t SweepIndex::memoryUsage() const
+{
+    return (anchor.capacity() + left.capacity()) * sizeof(double) +
+        (order.capacity() + rank.capacity()) * sizeof(uint32_t);
+}
+
+void SweepIndex::swap(size_t k, size_t l)
+{
+    std::swap(order[k], order[l]);
+    std::swap(left[k], left[l]);
+    rank[order[k]] = k;
+    rank[order[l]] = l;
+}
+
+// The order only depends on the anchors, so it's the same whether the
+// particles got there one by one or all at once.
+void SweepIndex::reindex(const ParticleStore &particles)
+{
+    uint32_t n = particles.size();
+
+    max_width = 2.0 * (particles.getMaxRadius() + horizon);
+
+    order.resize(n);
+    left.resize(n);
+    rank.resize(n);
+    for (uint32_t i = 0; i < n; i++)
+        order[i] = i;
+
+    std::sort(order.begin(), order.end(), [&](uint32_t i, uint32_t j) {
+        double li = leftOf(particles, i), lj = leftOf(particles, j);
+
+        return (li < lj) || (li == lj && i < j);
+    });
+
+    for (uint32_t k = 0; k < n; k++) {
+        left[k] = leftOf(particles, order[k]);
+        rank[order[k]] = k;
+    }
+}
+
+void SweepIndex::build(const ParticleStore &particles, double time)
+{
+    anchor.resize(particles.size());
+    for (uint32_t i = 0; i < particles.size(); i++)
+        anchor[i] = particles.getX(i, time);
+
+    reindex(particles);
+}
+
+void SweepIndex::update(const ParticleStore &particles, uint32_t i,
+                        double time)
+{
+    size_t k = rank[i];
+    double l;
+
+    anchor[i] = particles.getX(i, time);
+    l = leftOf(particles, i);
+    left[k] = l;
+
+    // the particle has moved by the horizon at most since it was
+    // put to its place, so there are few particles to pass
+    while (k + 1 < order.size() &&
+           (left[k + 1] < l || (left[k + 1] == l && order[k + 1] < i))) {
+        swap(k, k + 1);
+        k++;
+    }
+
+    while (k > 0 && (left[k - 1] > l || (left[k - 1] == l && order[k - 1] > i))) {
+        swap(k - 1, k);
+        k--;
+    }
+}
+
+void SweepIndex::candidates(const ParticleStore &particles, uint32_t i,
+                            std::vector<uint32_t> &out) const
+{
+    double lo = left[rank[i]];
+    double hi = lo + 2.0 * (particles.getRadius(i) + horizon);
+    size_t k = std::lower_bound(left.begin(), left.end(), lo - max_width) -
+        left.begin();
+
+    // the intervals starting before @hi, the ones
+    // ending before @lo are left out
+    for (; k < order.size() && left[k] <= hi; k++) {
+        uint32_t j = order[k];
+
+        if (j != i && left[k] + 2.0 * (particles.getRadius(j) + horizon) >= lo)
+            out.push_back(j);
+    }
+}
+
+// The particle moves along x at constant speed from its position at t,
+// so its interval expires once x gets the horizon away from the anchor.
+// The position at t may be long before the anchor was set, the offset
+// from the anchor takes care of that.
+double SweepIndex::predictExpiry(const ParticleStore &particles,
+                                 uint32_t i) const
+{
+    double dx = particles.getX(i) - anchor[i];
+    double vx = particles.getVX(i);
+    double dt;
+
+    if (vx > 0.0)
+        dt = (horizon - dx) / vx;
+    else if (vx < 0.0)
+        dt = (-horizon - dx) / vx;
+    else
+        return -1.0;
+
+    return particles.getTime(i) + std::max(dt, 0.0);
+}
@@ -0,0 +1,80 @@
+#ifndef _SWEEP_INDEX_HPP_
+#define _SWEEP_INDEX_HPP_
+
+#include <vector>
+#include <cstdint>
+#include "particle_store.hpp"
+
+/*
+ * Sort-and-sweep broadphase along the x axis.
+ *
+ * Every particle has an anchor: its x at the moment it was last put
+ * into the index. Its interval is the anchor plus and minus the radius
+ * and the horizon, and the particles are kept sorted by the left ends
+ * of their intervals. As long as the particles stay within the horizon
+ * from their anchors, two particles whose intervals do not overlap
+ * can't touch each other, so a particle has to be tested only against
+ * the ones found by sweeping the sorted intervals around its own one.
+ *
+ * The simulation asks when a particle is going to get further than the
+ * horizon from its anchor (the interval expires then) and puts it to
+ * the index again when that happens: the particle gets a new anchor and
+ * is moved to its new place in the order by swapping it with the next
+ * ones, which is cheap since it has not moved far. Nothing depends on
+ * y, so it works best for boxes elongated along x and for particles
+ * gathered in a part of the box, where a uniform grid has many empty
+ * cells or a few crowded ones.
+ */
+class SweepIndex {
+private:
+    // saves and restores the state directly
+    friend class Checkpoint;
+
+    double horizon;
+    // the widest interval, the sweep starts that far to the left
+    double max_width;
+    std::vector<double> anchor;
+
+    // particles sorted by the left ends of their intervals (ties by
+    // the index), the left ends themselves and the rank of every
+    // particle in the order
+    std::vector<uint32_t> order;
+    std::vector<double> left;
+    std::vector<uint32_t> rank;
+
+    double leftOf(const ParticleStore &particles, uint32_t i) const {
+        return anchor[i] - particles.getRadius(i) - horizon;
+    }
+
+    void swap(size_t k, size_t l);
+    // sorts the particles by their anchors
+    void reindex(const ParticleStore &particles);
+
+public:
+    explicit SweepIndex(double horizon);
+    ~SweepIndex() {};
+
+    double getHorizon() const {
+        return horizon;
+    }
+
+    // puts all the particles to the index at their positions at @time
+    void build(const ParticleStore &particles, double time);
+
+    // gives particle @i a new anchor at its position at @time
+    void update(const ParticleStore &particles, uint32_t i, double time);
+
+    // appends the particles whose intervals overlap with the interval
+    // of particle @i (the particle itself excluded) to @out.
+    void candidates(const ParticleStore &particles, uint32_t i,
+                    std::vector<uint32_t> &out) const;
+
+    // get the time at which the interval of particle @i expires,
+    // -1 if the particle does not move along x.
+    double predictExpiry(const ParticleStore &particles, uint32_t i) const;
+
+    // bytes allocated by the index
+    size_t memoryUsage() const;
+};
+
+#endif /* _SWEEP_INDEX_HPP_ */
@@ -0,0 +1,92 @@
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(unsigned nthreads)
+{
+    task = nullptr;
+    ntasks = 0;
+    next_task = 0;
+    batch = 0;
+    busy = 0;
+    stopping = false;
+
+    for (unsigned i = 1; i < nthreads; i++)
+        workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+
+    wakeup.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::drain(unsigned thread)
+{
+    while (true) {
+        size_t n = next_task++;
+
+        if (n >= ntasks)
+            break;
+
+        try {
+            (*task)(n, thread);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (!error)
+                error = std::current_exception();
+            // the rest of the batch is skipped
+            next_task = ntasks;
+        }
+    }
+}
+
+void ThreadPool::work(unsigned thread)
+{
+    unsigned seen = 0;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            wakeup.wait(lock, [&] { return stopping || batch != seen; });
+            if (stopping)
+                return;
+            seen = batch;
+        }
+
+        drain(thread);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0)
+            finished.notify_one();
+    }
+}
+
+void ThreadPool::run(size_t ntasks, const Task &task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        this->task = &task;
+        this->ntasks = ntasks;
+        next_task = 0;
+        error = nullptr;
+        busy = workers.size();
+        batch++;
+    }
+
+    wakeup.notify_all();
+    drain(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return busy == 0; });
+    if (error)
+        std::rethrow_exception(error);
+}
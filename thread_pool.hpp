@@ -0,0 +1,60 @@
+#ifndef _THREAD_POOL_HPP_
+#define _THREAD_POOL_HPP_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+
+/*
+ * A fixed set of threads running batches of independent tasks.
+ *
+ * run() hands out task numbers [0, ntasks) one by one to whichever
+ * thread is free, so tasks of different cost are balanced between
+ * threads. The thread calling run() works on the tasks too and
+ * returns when all of them are done. Every task also gets the number
+ * of the thread running it, in range [0, size()), so that tasks can
+ * keep per-thread buffers without any locking.
+ */
+class ThreadPool {
+public:
+    typedef std::function<void(size_t task, unsigned thread)> Task;
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeup, finished;
+
+    // the batch being run
+    const Task *task;
+    size_t ntasks;
+    std::atomic<size_t> next_task;
+    unsigned batch; // incremented for every new batch
+    unsigned busy; // number of workers still running the batch
+    bool stopping;
+    std::exception_ptr error;
+
+    void work(unsigned thread);
+    void drain(unsigned thread);
+
+public:
+    // @nthreads includes the thread calling run()
+    explicit ThreadPool(unsigned nthreads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const {
+        return workers.size() + 1;
+    }
+
+    // runs tasks [0, @ntasks) and waits for them to finish; the first
+    // exception thrown by a task (if any) is rethrown here.
+    void run(size_t ntasks, const Task &task);
+};
+
+#endif /* _THREAD_POOL_HPP_ */
@@ -0,0 +1,349 @@
+#include <cstring>
+#include <cerrno>
+#include "trajectory.hpp"
+
+namespace {
+
+const char magic[8] = {'P', 'A', 'R', 'T', 'T', 'R', 'A', 'J'};
+const uint32_t byte_order = 0x01020304;
+const uint32_t version = 1;
+
+enum : uint32_t {
+    Compressed = 1,
+};
+
+struct Header {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t version;
+    uint32_t nparticles;
+    uint32_t flags;
+    int32_t width, height;
+    double interval;
+};
+
+struct FrameHeader {
+    double time;
+    uint64_t nbytes; // size of the payload
+};
+
+// control bytes of the zero run encoding: [0, 127] stand for
+// 1-128 literal bytes that follow, [128, 255] for 1-128 zeros.
+const size_t max_run = 128;
+
+// XOR with the previous frame, group the bytes by their position
+// within a double and squeeze out the runs of zeros. @prev is
+// updated to the current frame.
+void encode(const std::vector<double> &cur, std::vector<double> &prev,
+            std::vector<uint8_t> &scratch, std::vector<uint8_t> &out)
+{
+    size_t n = cur.size(), nbytes = n * sizeof(double);
+
+    scratch.resize(nbytes);
+    for (size_t k = 0; k < n; k++) {
+        uint64_t a, b;
+
+        memcpy(&a, &cur[k], sizeof(a));
+        memcpy(&b, &prev[k], sizeof(b));
+        a ^= b;
+        for (size_t byte = 0; byte < sizeof(a); byte++)
+            scratch[byte * n + k] = (a >> (8 * byte)) & 0xff;
+    }
+    prev = cur;
+
+    out.clear();
+    for (size_t i = 0; i < nbytes; ) {
+        size_t run = 0;
+
+        if (scratch[i] == 0) {
+            while (i + run < nbytes && run < max_run && scratch[i + run] == 0)
+                run++;
+            out.push_back(127 + run);
+            i += run;
+            continue;
+        }
+
+        // a single zero is cheaper to keep within literals
+        while (i + run < nbytes && run < max_run &&
+               !(scratch[i + run] == 0 && i + run + 1 < nbytes &&
+                 scratch[i + run + 1] == 0)) {
+            run++;
+        }
+        out.push_back(run - 1);
+        out.insert(out.end(), &scratch[i], &scratch[i] + run);
+        i += run;
+    }
+}
+
+// reverses encode(), @prev is updated to the decoded frame.
+bool decode(const std::vector<uint8_t> &in, std::vector<double> &prev,
+            std::vector<uint8_t> &scratch, std::vector<double> &cur)
+{
+    size_t n = prev.size(), nbytes = n * sizeof(double);
+
+    scratch.clear();
+    for (size_t i = 0; i < in.size(); ) {
+        size_t c = in[i++];
+
+        if (c >= 128) {
+            scratch.insert(scratch.end(), c - 127, 0);
+        }
+        else {
+            if (i + c + 1 > in.size())
+                return false;
+            scratch.insert(scratch.end(), &in[i], &in[i] + c + 1);
+            i += c + 1;
+        }
+    }
+    if (scratch.size() != nbytes)
+        return false;
+
+    cur.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        uint64_t a = 0, b;
+
+        for (size_t byte = 0; byte < sizeof(a); byte++)
+            a |= (uint64_t)scratch[byte * n + k] << (8 * byte);
+        memcpy(&b, &prev[k], sizeof(b));
+        a ^= b;
+        memcpy(&cur[k], &a, sizeof(a));
+    }
+    prev = cur;
+
+    return true;
+}
+
+}
+
+TrajectoryWriter::TrajectoryWriter(const std::string &path,
+                                   const ParticleStore &particles,
+                                   int width, int height, double interval,
+                                   bool compress)
+    : file(path, std::ios::binary | std::ios::trunc), path(path)
+{
+    Header header;
+    std::vector<int32_t> radius, mass;
+
+    if (file.fail())
+        throw TrajectoryError(path + ": " + strerror(errno));
+
+    nparticles = particles.size();
+    this->compress = compress;
+    nframes = 0;
+    closing = false;
+    previous.assign(4 * nparticles, 0.0);
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, magic, sizeof(magic));
+    header.byte_order = byte_order;
+    header.version = version;
+    header.nparticles = nparticles;
+    if (compress)
+        header.flags |= Compressed;
+    header.width = width;
+    header.height = height;
+    header.interval = interval;
+
+    for (uint32_t i = 0; i < nparticles; i++) {
+        radius.push_back(particles.getRadius(i));
+        mass.push_back(particles.getMass(i));
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(radius.data()),
+               radius.size() * sizeof(int32_t));
+    file.write(reinterpret_cast<const char *>(mass.data()),
+               mass.size() * sizeof(int32_t));
+    if (file.fail())
+        throw TrajectoryError(path + ": " + strerror(errno));
+
+    writer = std::thread(&TrajectoryWriter::work, this);
+}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    try {
+        close();
+    }
+    catch (TrajectoryError &) {
+        // nobody to report it to anymore
+    }
+}
+
+void TrajectoryWriter::write(const ParticleStore &particles, double time)
+{
+    std::unique_ptr<TrajectoryFrame> frame;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (!error.empty())
+            throw TrajectoryError(error);
+
+        written.wait(lock, [&] { return pending.size() < max_pending; });
+        if (!spare.empty()) {
+            frame = std::move(spare.front());
+            spare.pop_front();
+        }
+    }
+
+    if (!frame) {
+        frame.reset(new TrajectoryFrame);
+        frame->columns.resize(4 * nparticles);
+    }
+
+    double *x = &frame->columns[0], *y = x + nparticles;
+    double *vx = y + nparticles, *vy = vx + nparticles;
+
+    frame->time = time;
+    for (uint32_t i = 0; i < nparticles; i++) {
+        x[i] = particles.getX(i, time);
+        y[i] = particles.getY(i, time);
+        vx[i] = particles.getVX(i);
+        vy[i] = particles.getVY(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(std::move(frame));
+    }
+    ready.notify_one();
+    nframes++;
+}
+
+void TrajectoryWriter::close()
+{
+    if (!writer.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closing = true;
+    }
+    ready.notify_one();
+    writer.join();
+
+    file.close();
+    if (error.empty() && file.fail())
+        error = path + ": " + strerror(errno);
+    if (!error.empty())
+        throw TrajectoryError(error);
+}
+
+void TrajectoryWriter::work()
+{
+    while (true) {
+        std::unique_ptr<TrajectoryFrame> frame;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            ready.wait(lock, [&] { return closing || !pending.empty(); });
+            if (pending.empty())
+                return;
+            frame = std::move(pending.front());
+            pending.pop_front();
+        }
+
+        // once something went wrong the rest of the frames
+        // are dropped, write() reports the error
+        if (error.empty())
+            store(*frame);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            spare.push_back(std::move(frame));
+        }
+        written.notify_one();
+    }
+}
+
+void TrajectoryWriter::store(const TrajectoryFrame &frame)
+{
+    FrameHeader header;
+    const char *payload;
+
+    header.time = frame.time;
+    if (compress) {
+        encode(frame.columns, previous, scratch, encoded);
+        header.nbytes = encoded.size();
+        payload = reinterpret_cast<const char *>(encoded.data());
+    }
+    else {
+        header.nbytes = frame.columns.size() * sizeof(double);
+        payload = reinterpret_cast<const char *>(frame.columns.data());
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(payload, header.nbytes);
+    if (file.fail()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = path + ": " + strerror(errno);
+    }
+}
+
+TrajectoryReader::TrajectoryReader(const std::string &path)
+    : file(path, std::ios::binary), path(path)
+{
+    Header header;
+
+    if (file.fail())
+        throw TrajectoryError(path + ": " + strerror(errno));
+
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (file.fail() || memcmp(header.magic, magic, sizeof(magic)) != 0)
+        throw TrajectoryError(path + " is not a trajectory file");
+    if (header.byte_order != byte_order)
+        throw TrajectoryError(path + " was written on a machine with "
+                              "different byte order");
+    if (header.version != version) {
+        throw TrajectoryError(path + " has unsupported version " +
+                              std::to_string(header.version));
+    }
+
+    nparticles = header.nparticles;
+    width = header.width;
+    height = header.height;
+    interval = header.interval;
+    compressed = (header.flags & Compressed) != 0;
+    previous.assign(4 * nparticles, 0.0);
+    radius.resize(nparticles);
+    mass.resize(nparticles);
+
+    file.read(reinterpret_cast<char *>(radius.data()),
+              nparticles * sizeof(int32_t));
+    file.read(reinterpret_cast<char *>(mass.data()),
+              nparticles * sizeof(int32_t));
+    if (file.fail())
+        throw TrajectoryError(path + " is truncated");
+}
+
+bool TrajectoryReader::next(TrajectoryFrame &frame)
+{
+    FrameHeader header;
+
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (file.gcount() == 0 && file.eof())
+        return false;
+    if (file.fail())
+        throw TrajectoryError(path + " is truncated");
+
+    frame.time = header.time;
+    if (compressed) {
+        encoded.resize(header.nbytes);
+        file.read(reinterpret_cast<char *>(encoded.data()), header.nbytes);
+        if (file.fail() || !decode(encoded, previous, scratch, frame.columns))
+            throw TrajectoryError(path + " has a broken frame");
+    }
+    else {
+        if (header.nbytes != 4 * nparticles * sizeof(double))
+            throw TrajectoryError(path + " has a broken frame");
+        frame.columns.resize(4 * nparticles);
+        file.read(reinterpret_cast<char *>(frame.columns.data()),
+                  header.nbytes);
+        if (file.fail())
+            throw TrajectoryError(path + " is truncated");
+    }
+
+    return true;
+}
@@ -0,0 +1,144 @@
+#ifndef _TRAJECTORY_HPP_
+#define _TRAJECTORY_HPP_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "particle_store.hpp"
+
+class TrajectoryError : public std::runtime_error {
+public:
+    explicit TrajectoryError(const std::string msg) :
+        std::runtime_error(msg) {};
+    virtual ~TrajectoryError() {};
+};
+
+/*
+ * Trajectory file format.
+ *
+ * The file starts with a header (magic, byte order, version, number
+ * of particles, box size, the interval between frames and whether
+ * frames are compressed) followed by radii and masses of particles,
+ * which never change. Then frames follow one after another, each one
+ * is a frame header (the time, the size of the payload) and the
+ * payload: columns x[N], y[N], vx[N], vy[N] of doubles.
+ *
+ * Compressed payloads are XORed with the previous frame, so the bits
+ * that did not change become zeros (the velocities of particles that
+ * did not collide are all zeros), the bytes are then grouped by their
+ * position within a double, putting the mostly zero high bytes
+ * together, and runs of zeros are squeezed out. It's cheap enough to
+ * keep up with the simulation, but frames can only be read in order.
+ */
+struct TrajectoryFrame {
+    double time;
+    // x, y, vx, vy of all particles one after another
+    std::vector<double> columns;
+};
+
+/*
+ * Streams frames of a simulation to a file.
+ *
+ * write() only copies positions and velocities to a buffer and hands
+ * it over to a background thread, which compresses frames and writes
+ * them to disk, so the simulation does not wait for the disk. Buffers
+ * are reused once they are written; a new one is allocated when all of
+ * them are waiting to be written, and the simulation is only held back
+ * when the writer thread falls behind by max_pending frames.
+ */
+class TrajectoryWriter {
+private:
+    static const size_t max_pending = 16;
+
+    std::ofstream file;
+    std::string path;
+    size_t nparticles;
+    bool compress;
+    uint64_t nframes;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable ready, written;
+    std::deque<std::unique_ptr<TrajectoryFrame>> pending, spare;
+    bool closing;
+    std::string error; // set by the writer thread
+
+    // used by the writer thread only
+    std::vector<double> previous;
+    std::vector<uint8_t> scratch, encoded;
+
+    void work();
+    void store(const TrajectoryFrame &frame);
+
+public:
+    TrajectoryWriter(const std::string &path, const ParticleStore &particles,
+                     int width, int height, double interval,
+                     bool compress = true);
+    ~TrajectoryWriter();
+
+    // queues a frame of @particles at @time; positions of particles
+    // which were last updated before that time are extrapolated.
+    void write(const ParticleStore &particles, double time);
+
+    // waits until all the frames are written and closes the file
+    void close();
+
+    uint64_t getFrameCount() const {
+        return nframes;
+    }
+};
+
+/*
+ * Reads frames of a trajectory file one after another.
+ */
+class TrajectoryReader {
+private:
+    std::ifstream file;
+    std::string path;
+    size_t nparticles;
+    int width, height;
+    double interval;
+    bool compressed;
+    std::vector<int32_t> radius, mass;
+    std::vector<double> previous;
+    std::vector<uint8_t> encoded, scratch;
+
+public:
+    explicit TrajectoryReader(const std::string &path);
+
+    size_t getParticleCount() const {
+        return nparticles;
+    }
+
+    int getWidth() const {
+        return width;
+    }
+
+    int getHeight() const {
+        return height;
+    }
+
+    double getInterval() const {
+        return interval;
+    }
+
+    int getRadius(size_t i) const {
+        return radius[i];
+    }
+
+    int getMass(size_t i) const {
+        return mass[i];
+    }
+
+    // reads the next frame, returns false at the end of the file
+    bool next(TrajectoryFrame &frame);
+};
+
+#endif /* _TRAJECTORY_HPP_ */
@@ -0,0 +1,256 @@
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <SDL2/SDL.h>
+
+#include "viewer.hpp"
+
+static const Uint32 background = 0xffffffff;
+
+// simulation time units per second of the wall clock at speed 1x
+static const double base_rate = 1000.0 / 60;
+
+// each step of speed up or down changes it by that factor
+static const double speed_step = 1.25;
+static const double speed_min = 1.0 / 64;
+static const double speed_max = 1024;
+
+// checking the clock is not free, so in fast-forward mode
+// it's done once per that many events
+static const int events_per_check = 256;
+
+Viewer::Viewer(Simulation &simulation, int fps)
+    : simulation(simulation),
+      speed(1), is_paused(false), fast_forward(false),
+      window(nullptr), renderer(nullptr), texture(nullptr),
+      framebuffer(simulation.getWidth(), simulation.getHeight()),
+      snapshots(simulation.getParticles().size()),
+      stopping(false), finished(false)
+{
+    const ParticleStore &particles = simulation.getParticles();
+    std::ostringstream oss;
+
+    frame_period = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(1.0 / fps));
+
+    // particles never change their size and color
+    for (uint32_t i = 0; i < particles.size(); i++) {
+        radius.push_back(particles.getRadius(i));
+        color.push_back(0xff000000 | particles.getColor(i));
+    }
+
+    window = SDL_CreateWindow("Particles", SDL_WINDOWPOS_UNDEFINED,
+                              SDL_WINDOWPOS_UNDEFINED, simulation.getWidth(),
+                              simulation.getHeight(), SDL_WINDOW_SHOWN);
+    if (window == nullptr) {
+        oss << "Failed to create window (SDL: " << SDL_GetError() << ")";
+        throw SimulationError(oss.str());
+    }
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED |
+                                  SDL_RENDERER_PRESENTVSYNC);
+    if (renderer == nullptr) {
+        oss << "Failed to create renderer (SDL: " << SDL_GetError() << ")";
+        release();
+        throw SimulationError(oss.str());
+    }
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                SDL_TEXTUREACCESS_STREAMING,
+                                simulation.getWidth(), simulation.getHeight());
+    if (texture == nullptr) {
+        oss << "Failed to create texture (SDL: " << SDL_GetError() << ")";
+        release();
+        throw SimulationError(oss.str());
+    }
+
+    // the first snapshot is published before the playing
+    // thread starts, it's the only writer afterwards
+    publish();
+    deadline = Clock::now() + frame_period;
+    player = std::thread(&Viewer::play, this);
+}
+
+Viewer::~Viewer()
+{
+    stop();
+    release();
+}
+
+void Viewer::release()
+{
+    if (texture != nullptr)
+        SDL_DestroyTexture(texture);
+    if (renderer != nullptr)
+        SDL_DestroyRenderer(renderer);
+    if (window != nullptr)
+        SDL_DestroyWindow(window);
+    texture = nullptr;
+    renderer = nullptr;
+    window = nullptr;
+}
+
+void Viewer::stop()
+{
+    stopping = true;
+    if (player.joinable())
+        player.join();
+}
+
+void Viewer::close()
+{
+    stop();
+    if (failure) {
+        std::exception_ptr e = failure;
+
+        failure = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+// the playing thread, an error stops it and is
+// passed to the main thread by close()
+void Viewer::play()
+{
+    try {
+        while (!stopping)
+            tick();
+    }
+    catch (...) {
+        failure = std::current_exception();
+    }
+
+    finished = true;
+}
+
+void Viewer::tick()
+{
+    if (is_paused) {
+        nextFrame();
+        return;
+    }
+
+    if (fast_forward) {
+        // play as many events as fit into the frame
+        for (int n = 1; ; n++) {
+            if (simulation.nextEventTime() ==
+                std::numeric_limits<double>::infinity()) {
+                nextFrame();
+                return;
+            }
+            simulation.processEvent();
+            if (n % events_per_check == 0 && Clock::now() >= deadline)
+                break;
+        }
+
+        simulation.advance(simulation.getTime());
+        publish();
+        deadline = Clock::now() + frame_period;
+        return;
+    }
+
+    std::chrono::duration<double> period = frame_period;
+    double frame_end = simulation.getTime() +
+        period.count() * base_rate * speed;
+
+    while (simulation.nextEventTime() <= frame_end)
+        simulation.processEvent();
+
+    simulation.advance(frame_end);
+    publish();
+    nextFrame();
+}
+
+// Sleeps until the current frame is due. A frame that took longer
+// than it should have is not made up for: the simulation just plays
+// slower than requested, rather than trying to catch up in bursts.
+void Viewer::nextFrame()
+{
+    Clock::time_point now = Clock::now();
+
+    if (now < deadline)
+        std::this_thread::sleep_until(deadline);
+    else
+        deadline = now;
+
+    deadline += frame_period;
+}
+
+void Viewer::pause()
+{
+    is_paused = true;
+}
+
+void Viewer::resume()
+{
+    is_paused = false;
+}
+
+bool Viewer::paused() const
+{
+    return is_paused;
+}
+
+void Viewer::incSpeed()
+{
+    speed = std::min(speed.load() * speed_step, speed_max);
+}
+
+void Viewer::decSpeed()
+{
+    speed = std::max(speed.load() / speed_step, speed_min);
+}
+
+double Viewer::getSpeed() const
+{
+    return speed;
+}
+
+bool Viewer::fastForwarding() const
+{
+    return fast_forward;
+}
+
+void Viewer::toggleFastForward()
+{
+    fast_forward = !fast_forward;
+}
+
+// all the particles are at the current time after advance()
+void Viewer::publish()
+{
+    const ParticleStore &particles = simulation.getParticles();
+    Snapshot &snapshot = snapshots.getBack();
+
+    snapshot.time = simulation.getTime();
+    for (uint32_t i = 0; i < particles.size(); i++) {
+        snapshot.x[i] = std::round(particles.getX(i));
+        snapshot.y[i] = std::round(particles.getY(i));
+    }
+
+    snapshots.publish();
+}
+
+bool Viewer::show()
+{
+    if (!snapshots.acquire())
+        return false;
+
+    refresh(snapshots.getFront());
+    return true;
+}
+
+void Viewer::refresh(const Snapshot &snapshot)
+{
+    STATS_TIMER(stats, Phase::Refresh);
+
+    framebuffer.clear(background);
+    for (size_t i = 0; i < radius.size(); i++)
+        framebuffer.fillDisk(snapshot.x[i], snapshot.y[i], radius[i], color[i]);
+
+    SDL_UpdateTexture(texture, nullptr, framebuffer.getPixels(),
+                      framebuffer.getPitch());
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderPresent(renderer);
+}
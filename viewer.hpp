@@ -0,0 +1,105 @@
+#ifndef _VIEWER_HPP_
+#define _VIEWER_HPP_
+
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <vector>
+#include <exception>
+#include <SDL2/SDL.h>
+#include "simulation.hpp"
+#include "framebuffer.hpp"
+#include "snapshot.hpp"
+
+/*
+ * Interactive front-end of the simulation: shows it in an SDL window
+ * and plays it in (scaled) real time. The simulation itself knows
+ * nothing about SDL and can be run without any window at all.
+ *
+ * Frames are drawn by the CPU into a framebuffer and uploaded to a
+ * streaming texture once per refresh, so the cost of a frame depends
+ * on the number of pixels covered rather than on the number of calls
+ * to the renderer.
+ *
+ * The simulation is played on a thread of its own, the window, the
+ * renderer and everything else SDL stay on the main thread (SDL can
+ * only render from the thread that created the window). The playing
+ * thread publishes a snapshot of the positions at the end of each frame
+ * and moves on, it never waits for drawing (or vsync); show() draws the
+ * latest complete snapshot.
+ *
+ * The simulation is paced by the wall clock: all the events up to the
+ * end of a frame are processed at once and the playing thread sleeps
+ * (once) until the frame is due. The speed is the number of simulation
+ * time units played per second, relative to the default one; in
+ * fast-forward mode the simulation runs as fast as it can and is shown
+ * every frame.
+ */
+class Viewer {
+private:
+    Simulation &simulation;
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::duration frame_period;
+    Clock::time_point deadline; // when the current frame is due
+    // set by the main thread, read by the playing one
+    std::atomic<double> speed;
+    std::atomic<bool> is_paused;
+    std::atomic<bool> fast_forward;
+
+    // used by the main thread only
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    Framebuffer framebuffer;
+    std::vector<int32_t> radius;
+    std::vector<uint32_t> color;
+    Stats stats;
+
+    SnapshotBuffer snapshots;
+    std::thread player;
+    std::atomic<bool> stopping;
+    std::atomic<bool> finished;
+    std::exception_ptr failure; // what stopped the playing thread
+
+    void release();
+    void stop();
+    void play();
+    void tick();
+    void publish();
+    void refresh(const Snapshot &snapshot);
+    void nextFrame();
+
+public:
+    Viewer(Simulation &simulation, int fps);
+    virtual ~Viewer();
+
+    // stops the simulation, the window stays as it is; rethrows
+    // the error the simulation stopped with (if any)
+    void close();
+
+    // false once the simulation has failed
+    bool playing() const {
+        return !finished;
+    }
+
+    // timers of drawing
+    const Stats &getStats() const {
+        return stats;
+    }
+
+    bool paused() const;
+    void pause();
+    void resume();
+    void incSpeed();
+    void decSpeed();
+    double getSpeed() const;
+    bool fastForwarding() const;
+    void toggleFastForward();
+
+    // draws the latest snapshot if it has not been shown yet,
+    // returns false if there was nothing new
+    bool show();
+};
+
+#endif /* _VIEWER_HPP_ */